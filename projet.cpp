@@ -3,7 +3,7 @@
 #include <vector>             // Nécessaire pour std::vector
 #include <unordered_map>      // Nécessaire pour std::unordered_map
 #include <map>                // Nécessaire pour std::map
-#include <memory>             // Nécessaire pour std::shared_ptr, std::make_shared
+#include <memory>             // Nécessaire pour std::shared_ptr, std::make_shared, std::unique_ptr
 #include <algorithm>          // Nécessaire pour std::sort, std::find_if, std::remove_if
 #include <limits>             // Nécessaire pour std::numeric_limits
 #include <fstream>            // Nécessaire pour std::ifstream, std::ofstream
@@ -11,6 +11,36 @@
 #include <functional>         // Nécessaire pour std::hash (hachage)
 #include <sstream>            // Nécessaire pour std::stringstream
 #include <iomanip>            // Nécessaire pour std::hex, std::setw, std::setfill
+#include <cstdint>            // Nécessaire pour uint64_t, uint32_t
+#include <charconv>           // Nécessaire pour std::to_chars, std::from_chars
+#include <cstring>            // Nécessaire pour std::memcpy
+#include <string_view>        // Nécessaire pour std::string_view
+#include <queue>              // Nécessaire pour std::priority_queue
+#include <chrono>             // Nécessaire pour std::chrono (mesures de temps)
+#include <deque>              // Nécessaire pour std::deque (adresses stables)
+#include <mutex>              // Nécessaire pour std::mutex, std::lock_guard
+#include <tuple>              // Nécessaire pour std::tuple (pools par type)
+#include <type_traits>        // Nécessaire pour std::is_trivially_destructible
+#include <cerrno>             // Nécessaire pour errno, EINTR
+#include <thread>             // Nécessaire pour std::thread
+#include <unordered_set>      // Nécessaire pour std::unordered_set
+#include <ctime>              // Nécessaire pour std::strftime, std::localtime
+#include <cmath>              // Nécessaire pour std::pow
+#include <cctype>             // Nécessaire pour std::isspace, std::toupper
+#include <condition_variable> // Nécessaire pour std::condition_variable (pool de fils)
+#include <atomic>             // Nécessaire pour std::atomic
+#include <array>              // Nécessaire pour std::array
+#ifdef __unix__
+#include <fcntl.h>            // Nécessaire pour open
+#include <unistd.h>           // Nécessaire pour write, fsync, close
+#include <sys/file.h>         // Nécessaire pour flock (poste primaire unique)
+#endif
+#ifdef __linux__
+#include <sys/inotify.h>      // Nécessaire pour inotify (rechargement a chaud)
+#endif
+#ifdef __SSE2__
+#include <emmintrin.h>        // Nécessaire pour _mm_cmpeq_epi8 (lecture JSON / CSV)
+#endif
 
 using namespace std;
 namespace fs = std::filesystem;
@@ -22,6 +52,254 @@ void viderBuffer() {
     cin.ignore(numeric_limits<streamsize>::max(), '\n');
 }
 
+// Decoupe une ligne "a;b;c" en vues sur la ligne (le vecteur est reutilise)
+void decouperChamps(string_view ligne, vector<string_view>& champs) {
+    champs.clear();
+    size_t debut = 0, pos;
+    while ((pos = ligne.find(';', debut)) != string_view::npos) {
+        champs.push_back(ligne.substr(debut, pos - debut));
+        debut = pos + 1;
+    }
+    champs.push_back(ligne.substr(debut));
+}
+
+// Conversions sans exception ni allocation (0 si le champ est invalide)
+int lireEntier(string_view champ) {
+    int valeur = 0;
+    from_chars(champ.data(), champ.data() + champ.size(), valeur);
+    return valeur;
+}
+
+long long lireEntierLong(string_view champ) {
+    long long valeur = 0;
+    from_chars(champ.data(), champ.data() + champ.size(), valeur);
+    return valeur;
+}
+
+double lireReel(string_view champ) {
+    double valeur = 0.0;
+    from_chars(champ.data(), champ.data() + champ.size(), valeur);
+    return valeur;
+}
+
+// Empreinte 64 bits d'un texte, 8 octets par tour (jamais 0)
+uint64_t empreinteTexte(string_view texte) {
+    uint64_t h = 0x9E3779B97F4A7C15ULL ^ texte.size();
+    size_t i = 0;
+    for (; i + 8 <= texte.size(); i += 8) {
+        uint64_t mot;
+        memcpy(&mot, texte.data() + i, 8);
+        h = (h ^ mot) * 0xFF51AFD7ED558CCDULL;
+        h ^= h >> 32;
+    }
+    uint64_t reste = 0;
+    memcpy(&reste, texte.data() + i, texte.size() - i);
+    h = (h ^ reste) * 0xC4CEB9FE1A85EC53ULL;
+    h ^= h >> 29;
+    return h | 1;
+}
+
+// Lit une reponse o/n sur une ligne (apres un getline)
+bool demanderOuiNon(const string& question) {
+    string reponse;
+    cout << question << " (o/n) : ";
+    getline(cin, reponse);
+    return !reponse.empty() && (reponse[0] == 'o' || reponse[0] == 'O');
+}
+
+// ==========================================
+// NORMALISATION DES TITRES (CASSE / ACCENTS)
+// ==========================================
+// La cle normalisee est calculee une seule fois par titre (chargement ou ajout)
+// pour que la recherche compare des octets deja repliés :
+// "Misérables", "MISERABLES" et "miserables" donnent tous "miserables".
+
+// Passe 8 octets ASCII en minuscules d'un coup (SWAR).
+// Precondition: aucun octet >= 0x80 dans le mot.
+inline uint64_t minusculesAscii8(uint64_t v) {
+    const uint64_t hauts = 0x8080808080808080ULL;
+    uint64_t geA = v + 0x3F3F3F3F3F3F3F3FULL;   // bit haut si octet >= 'A'
+    uint64_t gtZ = v + 0x2525252525252525ULL;   // bit haut si octet >  'Z'
+    uint64_t majuscules = (geA ^ gtZ) & hauts;
+    return v | (majuscules >> 2);               // 0x80 >> 2 == 0x20
+}
+
+// Lettre de base des points de code U+00C0..U+00FF.
+// '#' = conserver tel quel, '*' = ligature (voir ligatureLatine).
+static const char BASE_LATIN1[] =
+    "aaaaaa*ceeeeiiiidnooooo#ouuuuy**"
+    "aaaaaa*ceeeeiiiidnooooo#ouuuuy*y";
+
+// Lettre de base des points de code U+0100..U+017F (Latin etendu A).
+static const char BASE_LATIN_A[] =
+    "aaaaaaccccccccddddeeeeeeeeeegggggggghhhhiiiiiiiiii**jjkkk"
+    "llllllllllnnnnnnnnnoooooo**rrrrrrsssssssstttttt"
+    "uuuuuuuuuuuuwwyyyzzzzzzs";
+
+static const char* ligatureLatine(uint32_t cp) {
+    switch (cp) {
+        case 0xC6: case 0xE6:   return "ae";
+        case 0xDE: case 0xFE:   return "th";
+        case 0xDF:              return "ss";
+        case 0x132: case 0x133: return "ij";
+        case 0x152: case 0x153: return "oe";
+        default:                return nullptr;
+    }
+}
+
+// Ecrit la cle dans un tampon fourni (reutilisable d'un appel a l'autre)
+void normaliserCleDans(string_view texte, string& cle) {
+    cle.resize(texte.size());   // la cle n'est jamais plus longue que le texte
+    size_t n = texte.size(), i = 0, j = 0;
+    const char* src = texte.data();
+
+    while (i < n) {
+        // Chemin rapide: blocs de 8 octets purement ASCII
+        while (i + 8 <= n) {
+            uint64_t mot;
+            memcpy(&mot, src + i, 8);
+            if (mot & 0x8080808080808080ULL) break;
+            mot = minusculesAscii8(mot);
+            memcpy(&cle[j], &mot, 8);
+            i += 8; j += 8;
+        }
+        if (i >= n) break;
+
+        unsigned char c = static_cast<unsigned char>(src[i]);
+        if (c < 0x80) {
+            cle[j++] = static_cast<char>((c >= 'A' && c <= 'Z') ? c + 32 : c);
+            i++;
+            continue;
+        }
+
+        // Sequence UTF-8 sur 2 octets: lettres latines accentuees et diacritiques combinants
+        if ((c & 0xE0) == 0xC0 && i + 1 < n &&
+            (static_cast<unsigned char>(src[i + 1]) & 0xC0) == 0x80) {
+            uint32_t cp = ((c & 0x1Fu) << 6) | (static_cast<unsigned char>(src[i + 1]) & 0x3Fu);
+            char base = '#';
+            if (cp >= 0xC0 && cp <= 0xFF) base = BASE_LATIN1[cp - 0xC0];
+            else if (cp >= 0x100 && cp <= 0x17F) base = BASE_LATIN_A[cp - 0x100];
+            else if (cp >= 0x300 && cp <= 0x36F) { i += 2; continue; }   // accent combinant: supprime
+
+            if (base == '*') {
+                const char* lig = ligatureLatine(cp);   // 2 octets -> 2 lettres
+                cle[j++] = lig[0];
+                cle[j++] = lig[1];
+            } else if (base != '#') {
+                cle[j++] = base;
+            } else {
+                cle[j++] = src[i];
+                cle[j++] = src[i + 1];
+            }
+            i += 2;
+            continue;
+        }
+
+        // Autres sequences (3-4 octets, octets invalides): recopiees sans changement
+        cle[j++] = src[i++];
+    }
+
+    cle.resize(j);
+}
+
+string normaliserCle(string_view texte) {
+    string cle;
+    normaliserCleDans(texte, cle);
+    return cle;
+}
+
+// ==========================================
+// INTERNEMENT DES CHAINES
+// ==========================================
+// Les valeurs tres repetees (auteurs, editeurs, qualites, formats, roles)
+// sont stockees une seule fois. Chaque objet ne garde qu'un Symbole de 8 octets
+// et les comparaisons deviennent des comparaisons de pointeurs.
+class PoolChaines {
+public:
+    struct Entree {
+        string texte;
+        uint32_t id;
+        mutable atomic<uint32_t> conservees{0};   // references gardees par des objets
+
+        Entree(string_view texte, uint32_t id) : texte(texte), id(id) {}
+    };
+
+private:
+    deque<Entree> entrees;                              // adresses stables
+    unordered_map<string_view, const Entree*> index;    // vues sur entrees[i].texte
+    mutable mutex verrou;
+    atomic<long long> references{0};
+    atomic<long long> octetsEvites{0};
+
+    // Copie evitee par une reference de plus: l'objet string et, hors SSO,
+    // son tampon sur le tas
+    static long long economie(const Entree& e) {
+        long long octets = static_cast<long long>(sizeof(string) - sizeof(const Entree*));
+        if (e.texte.size() >= sizeof(string) / 2) octets += static_cast<long long>(e.texte.size() + 1);
+        return octets;
+    }
+
+public:
+    static PoolChaines& global() {
+        static PoolChaines pool;
+        return pool;
+    }
+
+    const Entree* interner(string_view texte) {
+        lock_guard<mutex> garde(verrou);
+        auto it = index.find(texte);
+        if (it != index.end()) return it->second;
+        entrees.emplace_back(texte, static_cast<uint32_t>(entrees.size()));
+        const Entree* e = &entrees.back();
+        index.emplace(e->texte, e);
+        return e;
+    }
+
+    // Reference gardee (signe = 1) ou rendue (signe = -1) par un objet qui
+    // vit au-dela d'une recherche: media construit, pret, reservation. Seules
+    // les references suivant la premiere evitent une copie.
+    void conserver(const Entree* e, int signe) {
+        references += signe;
+        if (signe > 0) {
+            if (e->conservees.fetch_add(1) >= 1) octetsEvites += economie(*e);
+        } else {
+            if (e->conservees.fetch_sub(1) >= 2) octetsEvites -= economie(*e);
+        }
+    }
+
+    void afficherStatistiques() const {
+        lock_guard<mutex> garde(verrou);
+        cout << "Chaines internees : " << entrees.size() << " uniques pour "
+             << references << " references conservees" << endl;
+        cout << "Memoire economisee (estimation) : " << octetsEvites / 1024 << " Ko" << endl;
+    }
+};
+
+class Symbole {
+private:
+    const PoolChaines::Entree* entree;
+
+public:
+    Symbole() : Symbole(string_view()) {}
+    Symbole(string_view texte) : entree(PoolChaines::global().interner(texte)) {}
+    Symbole(const string& texte) : Symbole(string_view(texte)) {}
+    Symbole(const char* texte) : Symbole(string_view(texte)) {}
+
+    const string& str() const { return entree->texte; }
+    uint32_t id() const { return entree->id; }
+
+    // A appeler par les structures qui gardent le symbole (statistiques)
+    void conserver(int signe) const { PoolChaines::global().conserver(entree, signe); }
+
+    bool operator==(const Symbole& autre) const { return entree == autre.entree; }
+    bool operator!=(const Symbole& autre) const { return entree != autre.entree; }
+
+    friend ostream& operator<<(ostream& os, const Symbole& s) { return os << s.str(); }
+};
+
+// Symboles de reference, compares par pointeur
+const Symbole ROLE_CLIENT("Client"), ROLE_ADMIN("Admin"), ROLE_SUPERADMIN("SuperAdmin");
+
 // ==========================================
 // CLASSE UTILISATEUR 
 // ==========================================
@@ -29,7 +307,7 @@ class Utilisateur {
 private:
     string username;
     string passwordHash;
-    string role; // "Client", "Admin", "SuperAdmin"
+    Symbole role; // "Client", "Admin", "SuperAdmin"
 
     // Fonction de hachage simple
     static string hashPassword(const string& password) {
@@ -50,7 +328,8 @@ public:
 
     string getUsername() const { return username; }
     string getPasswordHash() const { return passwordHash; }
-    string getRole() const { return role; }
+    const string& getRole() const { return role.str(); }
+    Symbole getRoleSymbole() const { return role; }
 
     bool checkPassword(const string& pass) const {
         return passwordHash == hashPassword(pass);
@@ -159,12 +438,12 @@ public:
         // et du dernier SuperAdmin
         int nbSuperAdmin = 0;
         for (const auto& user : comptes) {
-            if (user.getRole() == "SuperAdmin") nbSuperAdmin++;
+            if (user.getRoleSymbole() == ROLE_SUPERADMIN) nbSuperAdmin++;
         }
         
         for (auto it = comptes.begin(); it != comptes.end(); ++it) {
             if (it->getUsername() == username) {
-                if (it->getRole() == "SuperAdmin" && nbSuperAdmin <= 1) {
+                if (it->getRoleSymbole() == ROLE_SUPERADMIN && nbSuperAdmin <= 1) {
                     cout << ">> Erreur: Impossible de supprimer le dernier SuperAdmin!" << endl;
                     return false;
                 }
@@ -209,6 +488,14 @@ public:
         return false;
     }
 
+    // Compte venu d'un import, empreinte deja calculee. Faux si le nom est
+    // pris; la sauvegarde est a la charge de l'appelant (une fois par import).
+    bool importerCompte(const string& username, const string& passwordHash, const string& role) {
+        if (usernameExiste(username)) return false;
+        comptes.push_back(Utilisateur(username, passwordHash, role, true));
+        return true;
+    }
+
     // Getter pour la fonction login
     const vector<Utilisateur>& getComptes() const {
         return comptes;
@@ -310,31 +597,288 @@ shared_ptr<Utilisateur> login(GestionUtilisateurs& gestionUsers) {
     }
 }
 
+// ==========================================
+// ALLOCATION EN ARENE
+// ==========================================
+// Les medias d'un catalogue et leurs titres sont alloues par gros blocs
+// possedes par la Bibliotheque: le chargement n'appelle presque jamais malloc
+// et la destruction libere quelques blocs au lieu de millions d'objets.
+
+// Chaines copiees les unes a la suite des autres dans des blocs de 64 Ko.
+// Rien n'est libere une par une: le proprietaire compacte en recopiant les
+// chaines encore referencees dans une nouvelle arene.
+class AreneChaines {
+private:
+    static constexpr size_t TAILLE_BLOC = 64 * 1024;
+    vector<unique_ptr<char[]>> blocs;
+    vector<pair<uintptr_t, size_t>> plages;   // (debut, taille) des blocs, tries par adresse
+    char* courant = nullptr;
+    size_t reste = 0;
+    size_t utilises = 0;
+
+public:
+    string_view copier(string_view texte) {
+        if (texte.empty()) return {};
+        if (texte.size() > reste) {
+            size_t taille = max(TAILLE_BLOC, texte.size());
+            blocs.push_back(make_unique<char[]>(taille));
+            courant = blocs.back().get();
+            reste = taille;
+            pair<uintptr_t, size_t> plage{reinterpret_cast<uintptr_t>(courant), taille};
+            plages.insert(upper_bound(plages.begin(), plages.end(), plage), plage);
+        }
+        char* dest = courant;
+        memcpy(dest, texte.data(), texte.size());
+        courant += texte.size();
+        reste -= texte.size();
+        utilises += texte.size();
+        return string_view(dest, texte.size());
+    }
+
+    // Vrai si le texte a ete copie dans cette arene (recherche dichotomique)
+    bool contient(string_view texte) const {
+        if (texte.empty()) return false;
+        uintptr_t debut = reinterpret_cast<uintptr_t>(texte.data());
+        auto it = upper_bound(plages.begin(), plages.end(), make_pair(debut, SIZE_MAX));
+        if (it == plages.begin()) return false;
+        --it;
+        return debut + texte.size() <= it->first + it->second;
+    }
+
+    // Octets copies depuis la creation (y compris ceux qui ne servent plus)
+    size_t taille() const { return utilises; }
+};
+
+// Titre affiche et sa cle normalisee (toutes deux dans l'arene)
+struct TitreMedia {
+    string_view texte;
+    string_view cle;
+};
+
+// Pool d'objets d'un seul type, par dalles de 1024 emplacements.
+// Les objets n'ont que des membres triviaux (vues, symboles, nombres):
+// on peut donc rendre les dalles sans appeler de destructeur.
+template <class T>
+class PoolObjets {
+private:
+    static constexpr size_t PAR_DALLE = 1024;
+    struct alignas(T) Emplacement {
+        unsigned char octets[sizeof(T)];
+    };
+
+    vector<unique_ptr<Emplacement[]>> dalles;
+    size_t utilisesDerniereDalle = PAR_DALLE;
+    vector<void*> libres;
+
+public:
+    template <class... Args>
+    T* creer(Args&&... args) {
+        static_assert(is_trivially_destructible<T>::value,
+                      "les objets en pool doivent etre trivialement destructibles");
+        void* place;
+        if (!libres.empty()) {
+            place = libres.back();
+            libres.pop_back();
+        } else {
+            if (utilisesDerniereDalle == PAR_DALLE) {
+                dalles.push_back(make_unique<Emplacement[]>(PAR_DALLE));
+                utilisesDerniereDalle = 0;
+            }
+            place = &dalles.back()[utilisesDerniereDalle++];
+        }
+        return new (place) T(forward<Args>(args)...);
+    }
+
+    // place = adresse de l'objet complet renvoyee par creer()
+    void liberer(void* place) { libres.push_back(place); }
+};
+
+// ==========================================
+// ECRITURE RAPIDE ET ATOMIQUE DES FICHIERS
+// ==========================================
+// Tampon de sortie formate avec std::to_chars (pas de locale ni d'iostream).
+class TamponEcriture {
+private:
+    string donnees;
+
+    template <class N>
+    TamponEcriture& nombre(N valeur) {
+        char tmp[32];
+        auto res = to_chars(tmp, tmp + sizeof(tmp), valeur);
+        donnees.append(tmp, res.ptr);
+        return *this;
+    }
+
+public:
+    void reserver(size_t octets) { donnees.reserve(octets); }
+    void vider() { donnees.clear(); }   // garde la capacite
+    size_t taille() const { return donnees.size(); }
+    const string& contenu() const { return donnees; }
+    string extraire() { return move(donnees); }
+
+    TamponEcriture& operator<<(string_view texte) { donnees.append(texte); return *this; }
+    TamponEcriture& operator<<(const char* texte) { donnees.append(texte); return *this; }
+    TamponEcriture& operator<<(const string& texte) { donnees.append(texte); return *this; }
+    TamponEcriture& operator<<(const Symbole& s) { donnees.append(s.str()); return *this; }
+    TamponEcriture& operator<<(char c) { donnees.push_back(c); return *this; }
+    TamponEcriture& operator<<(int valeur) { return nombre(valeur); }
+    TamponEcriture& operator<<(long long valeur) { return nombre(valeur); }
+    TamponEcriture& operator<<(size_t valeur) { return nombre(valeur); }
+    TamponEcriture& operator<<(double valeur) { return nombre(valeur); }   // forme la plus courte, relisible
+};
+
+// Ecrit le contenu dans chemin.tmp, le force sur disque, puis le renomme sur
+// chemin: un lecteur voit toujours l'ancien fichier complet ou le nouveau.
+bool ecrireFichierAtomique(const string& chemin, const string& contenu) {
+    const string temporaire = chemin + ".tmp";
+    const size_t BLOC = 1 << 20;   // ecritures par blocs de 1 Mo
+
+#ifdef __unix__
+    int fd = ::open(temporaire.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return false;
+    size_t ecrit = 0;
+    while (ecrit < contenu.size()) {
+        ssize_t n = ::write(fd, contenu.data() + ecrit, min(BLOC, contenu.size() - ecrit));
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            ::close(fd);
+            ::unlink(temporaire.c_str());
+            return false;
+        }
+        ecrit += static_cast<size_t>(n);
+    }
+    if (::fsync(fd) != 0 || ::close(fd) != 0) {
+        ::unlink(temporaire.c_str());
+        return false;
+    }
+    if (::rename(temporaire.c_str(), chemin.c_str()) != 0) {
+        ::unlink(temporaire.c_str());
+        return false;
+    }
+
+    // Rend le renommage lui-meme durable
+    string dossier = fs::absolute(chemin).parent_path().string();
+    int dfd = ::open(dossier.c_str(), O_RDONLY);
+    if (dfd >= 0) {
+        ::fsync(dfd);
+        ::close(dfd);
+    }
+    return true;
+#else
+    {
+        ofstream f(temporaire, ios::binary | ios::trunc);
+        if (!f) return false;
+        for (size_t ecrit = 0; ecrit < contenu.size(); ecrit += BLOC) {
+            f.write(contenu.data() + ecrit, static_cast<streamsize>(min(BLOC, contenu.size() - ecrit)));
+        }
+        f.flush();
+        if (!f) return false;
+    }
+    error_code ec;
+    fs::rename(temporaire, chemin, ec);
+    if (!ec) return true;
+    fs::remove(temporaire, ec);
+    return false;
+#endif
+}
+
+// Ecrit les fichiers dans l'ordre et s'arrete au premier echec.
+// Renvoie le nombre de fichiers ecrits.
+size_t ecrireFichiers(const vector<pair<string, string>>& fichiers) {
+    size_t ecrits = 0;
+    for (const auto& [chemin, contenu] : fichiers) {
+        if (!ecrireFichierAtomique(chemin, contenu)) {
+            cerr << "\n>> ERREUR: Echec de la sauvegarde de " << chemin << endl;
+            break;
+        }
+        ecrits++;
+    }
+    return ecrits;
+}
+
+// Avancement d'un envoi en arriere-plan: -1 tant qu'il n'est pas termine,
+// puis le nombre de fichiers ecrits
+using SuiviEcriture = shared_ptr<atomic<long>>;
+
+// Une ecriture de fichier en cours a la fois, hors du fil principal.
+// La deconnexion ne bloque pas; la lecture suivante du fichier attend la fin.
+class EcrivainArrierePlan {
+private:
+    thread enCours;
+
+public:
+    static EcrivainArrierePlan& global() {
+        static EcrivainArrierePlan ecrivain;
+        return ecrivain;
+    }
+
+    ~EcrivainArrierePlan() { attendre(); }
+
+    void attendre() {
+        if (enCours.joinable()) enCours.join();
+    }
+
+    // Les fichiers d'un meme envoi sont ecrits l'un apres l'autre par le meme fil
+    SuiviEcriture soumettre(vector<pair<string, string>> fichiers) {
+        attendre();
+        SuiviEcriture suivi = make_shared<atomic<long>>(-1);
+        enCours = thread([fichiers = move(fichiers), suivi]() {
+            suivi->store(static_cast<long>(ecrireFichiers(fichiers)));
+        });
+        return suivi;
+    }
+
+    SuiviEcriture soumettre(string chemin, string contenu) {
+        vector<pair<string, string>> fichiers;
+        fichiers.emplace_back(move(chemin), move(contenu));
+        return soumettre(move(fichiers));
+    }
+};
+
 // ==========================================
 // CLASSES MEDIA
 // ==========================================
 
+// Etiquette de type stockee dans chaque media (1 octet). L'ordre est celui
+// du registre REGISTRE_MEDIA plus bas.
+enum class TypeMedia : uint8_t { Livre, Video, Audio, Ebook, AudioBook };
+constexpr size_t NB_TYPES_MEDIA = 5;
+
 class Media {
 protected:
     int id;
-    string titre;
+    TypeMedia type;
     bool dispo;
+    string_view titre;
+    string_view cleTitre;   // titre normalise, calcule une fois pour la recherche
 
 public:
-    Media(int id, const string& titre, bool dispo) : id(id), titre(titre), dispo(dispo) {}
-    virtual ~Media() = default;
+    // Pas de fonctions virtuelles: le comportement propre a chaque type passe par
+    // REGISTRE_MEDIA, indexe par l'etiquette. Les medias vivent dans les pools
+    // types de la Bibliotheque et ne sont jamais detruits via un Media*.
+    Media(int id, TypeMedia type, TitreMedia titre, bool dispo)
+        : id(id), type(type), dispo(dispo), titre(titre.texte), cleTitre(titre.cle) {}
 
     int getId() const { return id; }
-    const string& getTitre() const { return titre; }
+    TypeMedia getType() const { return type; }
+    string_view getTitre() const { return titre; }
+    string_view getCleTitre() const { return cleTitre; }
     bool isDispo() const { return dispo; }
 
-    void emprunter() {
+    // Meme titre, a une autre adresse (compactage de l'arene)
+    void deplacerTitre(TitreMedia t) {
+        titre = t.texte;
+        cleTitre = t.cle;
+    }
+
+    bool emprunter() {
         if (dispo) {
             dispo = false;
             cout << ">> Succes: '" << titre << "' a ete emprunte." << endl;
-        } else {
-            cout << ">> Erreur: '" << titre << "' n'est pas disponible." << endl;
+            return true;
         }
+        cout << ">> Erreur: '" << titre << "' n'est pas disponible." << endl;
+        return false;
     }
 
     void retourner() {
@@ -342,364 +886,5413 @@ public:
         cout << ">> Info: '" << titre << "' a ete retourne." << endl;
     }
 
-    virtual void afficher(ostream& os) const = 0;
-    virtual int getDureeMinutes() const { return 0; }
-    virtual string getType() const = 0;
-
-    friend ostream& operator<<(ostream& os, const Media& m) {
-        m.afficher(os);
-        return os;
-    }
+    // Definies apres le registre
+    const char* getTypeNom() const;
+    int getDureeMinutes() const;
+    friend ostream& operator<<(ostream& os, const Media& m);
 };
 
 class Telechargeable {
 protected:
     double tailleMo;
-    string format;
+    Symbole format;
 
 public:
-    Telechargeable(double tailleMo, const string& format) : tailleMo(tailleMo), format(format) {}
-    virtual ~Telechargeable() = default;
+    Telechargeable(double tailleMo, Symbole format) : tailleMo(tailleMo), format(format) {}
 
     void afficherTelechargement(ostream& os) const {
         os << " [Fichier: " << format << " | " << tailleMo << " Mo]";
     }
 
     double getTailleMo() const { return tailleMo; }
-    const string& getFormat() const { return format; }
+    const string& getFormat() const { return format.str(); }
+};
+
+// Valeurs d'un media utiles aux rapports (vues sur des chaines qui survivent
+// au rapport: symboles internes ou ligne brute du fichier)
+struct LigneRapport {
+    TypeMedia type;
+    bool dispo;
+    string_view auteur;   // vide si sans objet
+    string_view groupe;   // qualite, editeur, format ou voix selon le type
+    int duree;
+    int pages;
+    double tailleMo;
 };
 
-class Livre : public virtual Media {
+inline string_view vueTexte(const Symbole& s) { return s.str(); }
+inline string_view vueTexte(string_view s) { return s; }
+
+// Champ d'un media garde ou rendu: seuls les symboles comptent
+inline void conserverChamp(const Symbole& s, int signe) { s.conserver(signe); }
+template <class V>
+void conserverChamp(const V&, int) {}
+
+// Chaque classe concrete fournit, sans virtuel:
+//   NB_CHAMPS          nombre de champs d'une ligne de bibliotheque.txt
+//   CHAMPS_ECHANGE     noms des champs propres au type dans types.ts (web)
+//   lireChamps<S>(c)   arguments du constructeur apres (id, titre, dispo);
+//                      S = string_view lit la ligne sans interner
+//   champs()           les memes valeurs, depuis l'objet
+//   remplirRapport     copie un tuple de champs dans une LigneRapport
+//   ecrireChamps(t)    champs propres au type, dans l'ordre de lireChamps
+//   afficher(os)       ligne d'affichage
+//   getDuree()         duree en minutes (0 si sans objet)
+class Livre : public Media {
 protected:
-    string auteur;
+    Symbole auteur;
     int nPage;
 
+    Livre(int id, TypeMedia type, TitreMedia titre, bool dispo, Symbole auteur, int nPage)
+        : Media(id, type, titre, dispo), auteur(auteur), nPage(nPage) {}
+
 public:
-    Livre(int id, const string& titre, bool dispo, const string& auteur, int nPage)
-        : Media(id, titre, dispo), auteur(auteur), nPage(nPage) {}
+    static constexpr size_t NB_CHAMPS = 6;
+    static constexpr const char* CHAMPS_ECHANGE[] = {"auteur", "nPage"};
+
+    Livre(int id, TitreMedia titre, bool dispo, Symbole auteur, int nPage)
+        : Livre(id, TypeMedia::Livre, titre, dispo, auteur, nPage) {}
 
-    void afficher(ostream& os) const override {
+    template <class S = Symbole>
+    static tuple<S, int> lireChamps(const vector<string_view>& c) {
+        return {c[4], lireEntier(c[5])};
+    }
+
+    tuple<Symbole, int> champs() const { return {auteur, nPage}; }
+
+    template <class Tup>
+    static void remplirRapport(const Tup& c, LigneRapport& r) {
+        r.auteur = vueTexte(get<0>(c));
+        r.pages = get<1>(c);
+    }
+
+    void ecrireChamps(TamponEcriture& t) const {
+        t << ";" << auteur << ";" << nPage;
+    }
+
+    void afficher(ostream& os) const {
         os << "[Livre] ID:" << id << " | " << titre
            << " | Auteur: " << auteur << " | " << nPage << "p"
            << " | Dispo: " << (dispo ? "Oui" : "Non");
     }
-    string getType() const override { return "Livre"; }
+    int getDuree() const { return 0; }
 
-    const string& getAuteur() const { return auteur; }
+    const string& getAuteur() const { return auteur.str(); }
     int getNpage() const { return nPage; }
 };
 
-class Video : public virtual Media {
+class Video : public Media {
 private:
     int duree;
-    string qualite;
+    Symbole qualite;
 
 public:
-    Video(int id, const string& titre, bool dispo, int duree, const string& qualite)
-        : Media(id, titre, dispo), duree(duree), qualite(qualite) {}
+    static constexpr size_t NB_CHAMPS = 6;
+    static constexpr const char* CHAMPS_ECHANGE[] = {"duree", "qualite"};
+
+    Video(int id, TitreMedia titre, bool dispo, int duree, Symbole qualite)
+        : Media(id, TypeMedia::Video, titre, dispo), duree(duree), qualite(qualite) {}
 
-    void afficher(ostream& os) const override {
+    template <class S = Symbole>
+    static tuple<int, S> lireChamps(const vector<string_view>& c) {
+        return {lireEntier(c[4]), c[5]};
+    }
+
+    tuple<int, Symbole> champs() const { return {duree, qualite}; }
+
+    template <class Tup>
+    static void remplirRapport(const Tup& c, LigneRapport& r) {
+        r.duree = get<0>(c);
+        r.groupe = vueTexte(get<1>(c));
+    }
+
+    void ecrireChamps(TamponEcriture& t) const {
+        t << ";" << duree << ";" << qualite;
+    }
+
+    void afficher(ostream& os) const {
         os << "[Video] ID:" << id << " | " << titre
            << " | Duree: " << duree << "min | " << qualite
            << " | Dispo: " << (dispo ? "Oui" : "Non");
     }
-    int getDureeMinutes() const override { return duree; }
-    string getType() const override { return "Video"; }
+    int getDuree() const { return duree; }
 
-    const string& getQualite() const { return qualite; }
+    const string& getQualite() const { return qualite.str(); }
 };
 
-class Audio : public virtual Media {
+class Audio : public Media {
 protected:
-    string publicateur;
+    Symbole publicateur;
     int duree;
 
 public:
-    Audio(int id, const string& titre, bool dispo, const string& publicateur, int duree)
-        : Media(id, titre, dispo), publicateur(publicateur), duree(duree) {}
+    static constexpr size_t NB_CHAMPS = 6;
+    static constexpr const char* CHAMPS_ECHANGE[] = {"publicateur", "duree"};
+
+    Audio(int id, TitreMedia titre, bool dispo, Symbole publicateur, int duree)
+        : Media(id, TypeMedia::Audio, titre, dispo), publicateur(publicateur), duree(duree) {}
 
-    void afficher(ostream& os) const override {
+    template <class S = Symbole>
+    static tuple<S, int> lireChamps(const vector<string_view>& c) {
+        return {c[4], lireEntier(c[5])};
+    }
+
+    tuple<Symbole, int> champs() const { return {publicateur, duree}; }
+
+    template <class Tup>
+    static void remplirRapport(const Tup& c, LigneRapport& r) {
+        r.groupe = vueTexte(get<0>(c));
+        r.duree = get<1>(c);
+    }
+
+    void ecrireChamps(TamponEcriture& t) const {
+        t << ";" << publicateur << ";" << duree;
+    }
+
+    void afficher(ostream& os) const {
         os << "[Audio] ID:" << id << " | " << titre
            << " | Pub: " << publicateur << " | " << duree << "min"
            << " | Dispo: " << (dispo ? "Oui" : "Non");
     }
-    int getDureeMinutes() const override { return duree; }
-    string getType() const override { return "Audio"; }
+    int getDuree() const { return duree; }
 
-    const string& getPublicateur() const { return publicateur; }
+    const string& getPublicateur() const { return publicateur.str(); }
 };
 
 class Ebook : public Livre, public Telechargeable {
 public:
-    Ebook(int id, const string& titre, const string& auteur, int nPage, double tailleMo, const string& format)
-        : Media(id, titre, true),
-          Livre(id, titre, true, auteur, nPage),
+    static constexpr size_t NB_CHAMPS = 8;
+    static constexpr const char* CHAMPS_ECHANGE[] = {"auteur", "nPage", "tailleMo", "format"};
+
+    Ebook(int id, TitreMedia titre, bool dispo, Symbole auteur, int nPage, double tailleMo, Symbole format)
+        : Livre(id, TypeMedia::Ebook, titre, dispo, auteur, nPage),
           Telechargeable(tailleMo, format) {}
 
-    void afficher(ostream& os) const override {
+    // Les anciennes sauvegardes repetaient auteur;pages avant les champs Ebook
+    template <class S = Symbole>
+    static tuple<S, int, double, S> lireChamps(const vector<string_view>& c) {
+        size_t d = c.size() >= 10 ? 6 : 4;
+        return {c[d], lireEntier(c[d + 1]), lireReel(c[d + 2]), c[d + 3]};
+    }
+
+    tuple<Symbole, int, double, Symbole> champs() const { return {auteur, nPage, tailleMo, format}; }
+
+    template <class Tup>
+    static void remplirRapport(const Tup& c, LigneRapport& r) {
+        r.auteur = vueTexte(get<0>(c));
+        r.pages = get<1>(c);
+        r.tailleMo = get<2>(c);
+        r.groupe = vueTexte(get<3>(c));
+    }
+
+    void ecrireChamps(TamponEcriture& t) const {
+        Livre::ecrireChamps(t);
+        t << ";" << tailleMo << ";" << format;
+    }
+
+    void afficher(ostream& os) const {
         Livre::afficher(os);
         Telechargeable::afficherTelechargement(os);
     }
-    string getType() const override { return "Ebook"; }
 };
 
-class AudioBook : public Livre, public Audio {
+// Livre lu: herite du livre, porte lui-meme les champs audio (plus de losange)
+class AudioBook : public Livre {
+private:
+    Symbole publicateur;
+    int duree;
+
 public:
-    AudioBook(int id, const string& titre, bool dispo, const string& auteur, int nPage, const string& publicateur, int duree)
-        : Media(id, titre, dispo),
-          Livre(id, titre, dispo, auteur, nPage),
-          Audio(id, titre, dispo, publicateur, duree) {}
+    static constexpr size_t NB_CHAMPS = 8;
+    static constexpr const char* CHAMPS_ECHANGE[] = {"auteur", "nPage", "publicateur", "duree"};
+
+    AudioBook(int id, TitreMedia titre, bool dispo, Symbole auteur, int nPage, Symbole publicateur, int duree)
+        : Livre(id, TypeMedia::AudioBook, titre, dispo, auteur, nPage),
+          publicateur(publicateur), duree(duree) {}
+
+    // Les anciennes sauvegardes prefixaient publicateur;duree
+    template <class S = Symbole>
+    static tuple<S, int, S, int> lireChamps(const vector<string_view>& c) {
+        size_t d = c.size() >= 10 ? 6 : 4;
+        return {c[d], lireEntier(c[d + 1]), c[d + 2], lireEntier(c[d + 3])};
+    }
+
+    tuple<Symbole, int, Symbole, int> champs() const { return {auteur, nPage, publicateur, duree}; }
+
+    template <class Tup>
+    static void remplirRapport(const Tup& c, LigneRapport& r) {
+        r.auteur = vueTexte(get<0>(c));
+        r.pages = get<1>(c);
+        r.groupe = vueTexte(get<2>(c));
+        r.duree = get<3>(c);
+    }
 
-    void afficher(ostream& os) const override {
+    void ecrireChamps(TamponEcriture& t) const {
+        Livre::ecrireChamps(t);
+        t << ";" << publicateur << ";" << duree;
+    }
+
+    void afficher(ostream& os) const {
         os << "[AudioBook] ID:" << id << " | " << titre
-           << " | Auteur: " << Livre::getAuteur()
-           << " | Voix: " << Audio::getPublicateur()
-           << " | Duree: " << Audio::getDureeMinutes() << "min"
+           << " | Auteur: " << getAuteur()
+           << " | Voix: " << getPublicateur()
+           << " | Duree: " << duree << "min"
            << " | Dispo: " << (dispo ? "Oui" : "Non");
     }
-    string getType() const override { return "AudioBook"; }
+    int getDuree() const { return duree; }
+
+    const string& getPublicateur() const { return publicateur.str(); }
 };
 
 // ==========================================
-// BIBLIOTHEQUE
+// REGISTRE DES TYPES DE MEDIA
 // ==========================================
-class Bibliotheque {
-private:
-    vector<shared_ptr<Media>> catalogue;
+// Table constexpr indexee par TypeMedia: un appel par enregistrement est un
+// simple saut indirect, sans RTTI ni comparaison de chaines.
+template <TypeMedia T> struct TraitsMedia;
+template <> struct TraitsMedia<TypeMedia::Livre>     { using Classe = Livre; };
+template <> struct TraitsMedia<TypeMedia::Video>     { using Classe = Video; };
+template <> struct TraitsMedia<TypeMedia::Audio>     { using Classe = Audio; };
+template <> struct TraitsMedia<TypeMedia::Ebook>     { using Classe = Ebook; };
+template <> struct TraitsMedia<TypeMedia::AudioBook> { using Classe = AudioBook; };
 
-public:
-    void ajouterMedia(shared_ptr<Media> media) {
-        catalogue.push_back(media);
+struct OperationsMedia {
+    TypeMedia type;
+    const char* nom;
+    bool estLivre;       // Livre, Ebook, AudioBook (derivent de Livre)
+    bool aDuree;         // Video, Audio, AudioBook
+    size_t nbChamps;
+    const char* const* champsEchange;   // nbChamps - 4 noms, dans l'ordre de la ligne
+    void (*afficher)(const Media&, ostream&);
+    void (*ecrireChamps)(const Media&, TamponEcriture&);
+    int (*dureeMinutes)(const Media&);
+};
+
+template <TypeMedia T>
+constexpr OperationsMedia operationsPour(const char* nom, bool aDuree) {
+    using C = typename TraitsMedia<T>::Classe;
+    static_assert(size(C::CHAMPS_ECHANGE) + 4 == C::NB_CHAMPS, "un nom par champ propre");
+    return {T, nom, is_base_of<Livre, C>::value, aDuree, C::NB_CHAMPS, C::CHAMPS_ECHANGE,
+            [](const Media& m, ostream& os) { static_cast<const C&>(m).afficher(os); },
+            [](const Media& m, TamponEcriture& t) { static_cast<const C&>(m).ecrireChamps(t); },
+            [](const Media& m) { return static_cast<const C&>(m).getDuree(); }};
+}
+
+constexpr OperationsMedia REGISTRE_MEDIA[NB_TYPES_MEDIA] = {
+    operationsPour<TypeMedia::Livre>("Livre", false),
+    operationsPour<TypeMedia::Video>("Video", true),
+    operationsPour<TypeMedia::Audio>("Audio", true),
+    operationsPour<TypeMedia::Ebook>("Ebook", false),
+    operationsPour<TypeMedia::AudioBook>("AudioBook", true),
+};
+
+constexpr bool registreOrdonne() {
+    for (size_t i = 0; i < NB_TYPES_MEDIA; i++) {
+        if (static_cast<size_t>(REGISTRE_MEDIA[i].type) != i) return false;
     }
+    return true;
+}
+static_assert(registreOrdonne(), "REGISTRE_MEDIA doit suivre l'ordre de TypeMedia");
 
-    void supprimerMedia(int id) {
-        size_t before = catalogue.size();
-        catalogue.erase(remove_if(catalogue.begin(), catalogue.end(),
-                                  [id](const shared_ptr<Media>& media) { return media->getId() == id; }),
-                        catalogue.end());
-        size_t after = catalogue.size();
+inline const OperationsMedia& operations(TypeMedia type) {
+    return REGISTRE_MEDIA[static_cast<size_t>(type)];
+}
 
-        if (after < before) {
-            cout << ">> Media ID " << id << " supprime." << endl;
-        } else {
-            cout << ">> ID introuvable." << endl;
+// Type designe par le premier champ d'une ligne du fichier
+inline bool typeDepuisNom(string_view nom, TypeMedia& type) {
+    for (const auto& ops : REGISTRE_MEDIA) {
+        if (nom == ops.nom) {
+            type = ops.type;
+            return true;
         }
     }
+    return false;
+}
 
-    void rechercherParTitre(const string& motCle) {
-        cout << "\n--- Resultats Recherche : " << motCle << " ---" << endl;
-        bool trouve = false;
-        for (const auto& media : catalogue) {
-            if (media->getTitre().find(motCle) != string::npos) {
-                cout << *media << endl;
-                trouve = true;
-            }
+// Appelle f(TraitsMedia<T>{}) pour l'etiquette donnee (switch -> table de sauts)
+template <class F>
+decltype(auto) selonType(TypeMedia type, F&& f) {
+    switch (type) {
+        case TypeMedia::Livre:  return f(TraitsMedia<TypeMedia::Livre>{});
+        case TypeMedia::Video:  return f(TraitsMedia<TypeMedia::Video>{});
+        case TypeMedia::Audio:  return f(TraitsMedia<TypeMedia::Audio>{});
+        case TypeMedia::Ebook:  return f(TraitsMedia<TypeMedia::Ebook>{});
+        default:                return f(TraitsMedia<TypeMedia::AudioBook>{});
+    }
+}
+
+inline const char* Media::getTypeNom() const { return operations(type).nom; }
+inline int Media::getDureeMinutes() const { return operations(type).dureeMinutes(*this); }
+
+inline ostream& operator<<(ostream& os, const Media& m) {
+    operations(m.type).afficher(m, os);
+    return os;
+}
+
+// ==========================================
+// AUTOCOMPLETION (TRIE COMPRESSE)
+// ==========================================
+// Trie radix sur les cles normalisees (titres et auteurs). Chaque noeud garde
+// en cache les K meilleures completions de son sous-arbre, donc une suggestion
+// coute O(longueur du prefixe) quel que soit le nombre de medias.
+class TrieSuggestions {
+public:
+    static constexpr size_t K = 8;
+
+private:
+    static constexpr uint32_t AUCUN = numeric_limits<uint32_t>::max();
+
+    struct Classement {
+        int score;
+        uint32_t entree;
+    };
+
+    struct Noeud {
+        string arete;                  // libelle compresse menant a ce noeud
+        vector<uint32_t> enfants;      // tries par premier octet de l'arete
+        uint32_t terminal = AUCUN;     // entree se terminant ici
+        vector<Classement> meilleurs;  // top-K du sous-arbre, score decroissant
+    };
+
+    struct Entree {
+        string texte;        // forme affichee (premiere rencontree)
+        int references = 0;  // nombre de medias portant ce texte
+        int popularite = 0;  // nombre d'emprunts
+        int score() const { return references + popularite; }
+    };
+
+    vector<Noeud> noeuds{1};   // noeud 0 = racine
+    vector<Entree> entrees;
+    vector<uint32_t> noeudsLibres, entreesLibres;
+
+    uint32_t nouveauNoeud() {
+        if (!noeudsLibres.empty()) {
+            uint32_t n = noeudsLibres.back();
+            noeudsLibres.pop_back();
+            noeuds[n] = Noeud();
+            return n;
         }
-        if (!trouve) cout << "Aucun resultat." << endl;
+        noeuds.emplace_back();
+        return static_cast<uint32_t>(noeuds.size() - 1);
     }
 
-    void changerStatut(int id, bool emprunt) {
-        auto it = find_if(catalogue.begin(), catalogue.end(), [id](const shared_ptr<Media>& media) { return media->getId() == id; });
-        if (it != catalogue.end()) {
-            if (emprunt) (*it)->emprunter();
-            else (*it)->retourner();
-        } else {
-            cout << ">> Media introuvable." << endl;
+    uint32_t trouverEnfant(uint32_t n, char c) const {
+        for (uint32_t e : noeuds[n].enfants) {
+            if (noeuds[e].arete[0] == c) return e;
         }
+        return AUCUN;
     }
 
-    void afficherTout() {
-        cout << "\n--- CATALOGUE COMPLET (" << catalogue.size() << " medias) ---" << endl;
-        sort(catalogue.begin(), catalogue.end(),
-             [](const shared_ptr<Media>& a, const shared_ptr<Media>& b) {
-                 return a->getId() < b->getId();
-             });
+    void attacherEnfant(uint32_t parent, uint32_t enfant) {
+        auto& v = noeuds[parent].enfants;
+        char c = noeuds[enfant].arete[0];
+        auto it = find_if(v.begin(), v.end(), [&](uint32_t e) { return noeuds[e].arete[0] > c; });
+        v.insert(it, enfant);
+    }
 
-        for (const auto& media : catalogue) {
-            cout << *media << endl;
-        }
+    bool avant(const Classement& a, const Classement& b) const {
+        if (a.score != b.score) return a.score > b.score;
+        return entrees[a.entree].texte < entrees[b.entree].texte;
     }
 
-    void afficherStatistiques() {
-        int totalMedia = static_cast<int>(catalogue.size());
-        int totalDuree = 0;
-        int nbLivres = 0;
-        int nbDispo = 0;
+    // Score en hausse: on peut mettre a jour le cache sans recalcul
+    void remonter(uint32_t n, uint32_t entree) {
+        auto& m = noeuds[n].meilleurs;
+        m.erase(remove_if(m.begin(), m.end(), [entree](const Classement& c) { return c.entree == entree; }),
+                m.end());
+        Classement c{entrees[entree].score(), entree};
+        auto it = find_if(m.begin(), m.end(), [&](const Classement& x) { return avant(c, x); });
+        m.insert(it, c);
+        if (m.size() > K) m.pop_back();
+    }
 
-        for (const auto& media : catalogue) {
-            totalDuree += media->getDureeMinutes();
-            string type = media->getType();
-            if (type == "Livre" || type == "Ebook" || type == "AudioBook") nbLivres++;
-            if (media->isDispo()) nbDispo++;
+    // Score en baisse ou suppression: recalcul exact a partir des caches des enfants
+    void recalculer(uint32_t n) {
+        vector<Classement> candidats;
+        if (noeuds[n].terminal != AUCUN) {
+            candidats.push_back({entrees[noeuds[n].terminal].score(), noeuds[n].terminal});
         }
+        for (uint32_t e : noeuds[n].enfants) {
+            candidats.insert(candidats.end(), noeuds[e].meilleurs.begin(), noeuds[e].meilleurs.end());
+        }
+        size_t garde = min(K, candidats.size());
+        partial_sort(candidats.begin(), candidats.begin() + garde, candidats.end(),
+                     [this](const Classement& a, const Classement& b) { return avant(a, b); });
+        candidats.resize(garde);
+        noeuds[n].meilleurs = move(candidats);
+    }
 
-        cout << "\n--- STATISTIQUES ---" << endl;
-        cout << "Nombre total de medias : " << totalMedia << endl;
-        cout << "Medias disponibles : " << nbDispo << endl;
-        cout << "Duree totale (Audio/Video) : " << totalDuree << " min" << endl;
-        cout << "Nombre de livres (Papier/Ebook/AudioBook) : " << nbLivres << endl;
+    // Chemin racine -> noeud terminal de la cle (vide si la cle est absente)
+    vector<uint32_t> chemin(const string& cle) const {
+        vector<uint32_t> parcours{0};
+        uint32_t n = 0;
+        size_t i = 0;
+        while (i < cle.size()) {
+            uint32_t e = trouverEnfant(n, cle[i]);
+            if (e == AUCUN || cle.compare(i, noeuds[e].arete.size(), noeuds[e].arete) != 0) return {};
+            i += noeuds[e].arete.size();
+            n = e;
+            parcours.push_back(n);
+        }
+        return parcours;
     }
 
-    void sauvegarderDansFichier() {
-        string nomFichier = "bibliotheque.txt";
+    // Noeuds encore presents le long de la cle apres un compactage
+    vector<uint32_t> cheminSurvivant(const string& cle) const {
+        vector<uint32_t> parcours{0};
+        uint32_t n = 0;
+        size_t i = 0;
+        while (i < cle.size()) {
+            uint32_t e = trouverEnfant(n, cle[i]);
+            if (e == AUCUN || cle.compare(i, noeuds[e].arete.size(), noeuds[e].arete) != 0) break;
+            i += noeuds[e].arete.size();
+            n = e;
+            parcours.push_back(n);
+        }
+        return parcours;
+    }
 
-        ofstream f(nomFichier);
-        if (!f) {
-            cerr << ">> ERREUR: Impossible d'ouvrir le fichier pour ecriture!" << endl;
-            return;
+    // Supprime les noeuds devenus inutiles et recolle les aretes en chaine unique
+    void compacter(const vector<uint32_t>& parcours) {
+        for (size_t i = parcours.size() - 1; i > 0; i--) {
+            uint32_t n = parcours[i], parent = parcours[i - 1];
+            Noeud& noeud = noeuds[n];
+            if (noeud.terminal != AUCUN) continue;
+            if (noeud.enfants.empty()) {
+                auto& v = noeuds[parent].enfants;
+                v.erase(find(v.begin(), v.end(), n));
+                noeudsLibres.push_back(n);
+            } else if (noeud.enfants.size() == 1) {
+                uint32_t e = noeud.enfants[0];
+                noeuds[e].arete.insert(0, noeud.arete);
+                replace(noeuds[parent].enfants.begin(), noeuds[parent].enfants.end(), n, e);
+                noeudsLibres.push_back(n);
+            }
         }
+    }
 
-        for (const auto& media : catalogue) {
-            f << media->getType() << ";"
-              << media->getId() << ";"
-              << media->getTitre() << ";"
-              << (media->isDispo() ? "1" : "0");
+public:
+    void inserer(string_view texte) {
+        string cle = normaliserCle(texte);
+        if (cle.empty()) return;
 
-            if (auto livre = dynamic_pointer_cast<Livre>(media)) {
-                if (media->getType() != "AudioBook") {
-                    f << ";" << livre->getAuteur() << ";" << livre->getNpage();
+        vector<uint32_t> parcours{0};
+        uint32_t n = 0;
+        size_t i = 0;
+        while (i < cle.size()) {
+            uint32_t e = trouverEnfant(n, cle[i]);
+            if (e == AUCUN) {
+                e = nouveauNoeud();
+                noeuds[e].arete = cle.substr(i);
+                attacherEnfant(n, e);
+                i = cle.size();
+            } else {
+                const string& arete = noeuds[e].arete;
+                size_t commun = 0;
+                while (commun < arete.size() && i + commun < cle.size() && arete[commun] == cle[i + commun]) {
+                    commun++;
+                }
+                if (commun < arete.size()) {
+                    // Coupe l'arete: parent -> milieu -> e
+                    uint32_t milieu = nouveauNoeud();
+                    noeuds[milieu].arete = noeuds[e].arete.substr(0, commun);
+                    noeuds[milieu].meilleurs = noeuds[e].meilleurs;
+                    noeuds[e].arete.erase(0, commun);
+                    replace(noeuds[n].enfants.begin(), noeuds[n].enfants.end(), e, milieu);
+                    noeuds[milieu].enfants.push_back(e);
+                    e = milieu;
+                }
+                i += commun;
+            }
+            n = e;
+            parcours.push_back(n);
+        }
+
+        if (noeuds[n].terminal == AUCUN) {
+            uint32_t entree;
+            if (!entreesLibres.empty()) {
+                entree = entreesLibres.back();
+                entreesLibres.pop_back();
+                entrees[entree] = Entree();
+            } else {
+                entrees.emplace_back();
+                entree = static_cast<uint32_t>(entrees.size() - 1);
+            }
+            entrees[entree].texte = string(texte);
+            noeuds[n].terminal = entree;
+        }
+        uint32_t entree = noeuds[n].terminal;
+        entrees[entree].references++;
+        for (uint32_t p : parcours) remonter(p, entree);
+    }
+
+    void retirer(string_view texte) {
+        vector<uint32_t> parcours = chemin(normaliserCle(texte));
+        if (parcours.size() < 2 || noeuds[parcours.back()].terminal == AUCUN) return;
+
+        uint32_t entree = noeuds[parcours.back()].terminal;
+        if (--entrees[entree].references <= 0) {
+            noeuds[parcours.back()].terminal = AUCUN;
+            entreesLibres.push_back(entree);
+            compacter(parcours);
+            parcours = cheminSurvivant(normaliserCle(texte));
+        }
+        for (size_t i = parcours.size(); i-- > 0;) recalculer(parcours[i]);
+    }
+
+    void signalerEmprunt(string_view texte) {
+        vector<uint32_t> parcours = chemin(normaliserCle(texte));
+        if (parcours.size() < 2 || noeuds[parcours.back()].terminal == AUCUN) return;
+        uint32_t entree = noeuds[parcours.back()].terminal;
+        entrees[entree].popularite++;
+        for (uint32_t p : parcours) remonter(p, entree);
+    }
+
+    // scores (optionnel) recoit le score de chaque suggestion, pour fusionner
+    // les suggestions de plusieurs arbres
+    vector<string> suggerer(const string& prefixe, size_t k = K, vector<int>* scores = nullptr) const {
+        string cle = normaliserCle(prefixe);
+        uint32_t n = 0;
+        size_t i = 0;
+        while (i < cle.size()) {
+            uint32_t e = trouverEnfant(n, cle[i]);
+            if (e == AUCUN) return {};
+            const string& arete = noeuds[e].arete;
+            size_t reste = min(arete.size(), cle.size() - i);
+            if (cle.compare(i, reste, arete, 0, reste) != 0) return {};
+            i += reste;
+            n = e;
+        }
+
+        vector<string> resultats;
+        for (const auto& c : noeuds[n].meilleurs) {
+            if (resultats.size() >= k) break;
+            resultats.push_back(entrees[c.entree].texte);
+            if (scores) scores->push_back(c.score);
+        }
+        return resultats;
+    }
+};
+
+// ==========================================
+// SURVEILLANCE DU FICHIER (RECHARGEMENT A CHAUD)
+// ==========================================
+// Signale sans bloquer qu'un fichier a ete reecrit par un autre programme.
+// Sous Linux: inotify sur le dossier (les editeurs remplacent souvent le fichier
+// par renommage, ce qui ferait perdre une surveillance posee sur le fichier).
+// Ailleurs: comparaison de la date de modification.
+class SurveillanceFichier {
+private:
+    string nom;
+#ifdef __linux__
+    int fd = -1;
+#else
+    fs::file_time_type derniereModif;
+#endif
+
+public:
+    SurveillanceFichier() = default;
+    SurveillanceFichier(const SurveillanceFichier&) = delete;
+    SurveillanceFichier& operator=(const SurveillanceFichier&) = delete;
+
+    ~SurveillanceFichier() {
+#ifdef __linux__
+        if (fd >= 0) ::close(fd);
+#endif
+    }
+
+    bool demarrer(const string& fichier) {
+        nom = fs::path(fichier).filename().string();
+#ifdef __linux__
+        fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (fd < 0) return false;
+        string dossier = fs::absolute(fichier).parent_path().string();
+        return inotify_add_watch(fd, dossier.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) >= 0;
+#else
+        error_code ec;
+        derniereModif = fs::last_write_time(fichier, ec);
+        return true;
+#endif
+    }
+
+    // Vide la file d'evenements; vrai si le fichier surveille a change
+    bool changementDetecte() {
+#ifdef __linux__
+        if (fd < 0) return false;
+        bool change = false;
+        alignas(inotify_event) char tampon[4096];
+        ssize_t n;
+        while ((n = ::read(fd, tampon, sizeof(tampon))) > 0) {
+            for (char* p = tampon; p < tampon + n;) {
+                auto* ev = reinterpret_cast<inotify_event*>(p);
+                if (ev->len > 0 && nom == ev->name) change = true;
+                p += sizeof(inotify_event) + ev->len;
+            }
+        }
+        return change;
+#else
+        error_code ec;
+        auto modif = fs::last_write_time(nom, ec);
+        if (ec || modif == derniereModif) return false;
+        derniereModif = modif;
+        return true;
+#endif
+    }
+};
+
+// Que faire d'un enregistrement modifie a la fois en memoire et dans le fichier
+enum class PolitiqueConflit {
+    Fusion,         // champs descriptifs du fichier, disponibilite de la session
+    LocaleGagne,    // la version en memoire est gardee (et reecrite a la sauvegarde)
+    ExterneGagne    // la version du fichier remplace celle en memoire
+};
+
+// ==========================================
+// PRETS, ECHEANCES ET RESERVATIONS
+// ==========================================
+// Qui a emprunte quoi, quand, et pour quand. Chaque pret est chaine dans la
+// liste de son emprunteur et, une fois echu, dans la liste des retards:
+// les deux questions se repondent en temps proportionnel a la reponse.
+// Les echeances attendent dans un tas min; un retour laisse son entree
+// perimee dans le tas (numero de generation) plutot que de la chercher.
+using Horodatage = int64_t;   // secondes depuis l'epoque
+
+const Horodatage SECONDES_PAR_JOUR = 24 * 3600;
+const int DUREE_PRET_JOURS = 21;
+
+inline Horodatage maintenant() {
+    return chrono::duration_cast<chrono::seconds>(
+        chrono::system_clock::now().time_since_epoch()).count();
+}
+
+// Date AAAA-MM-JJ (heure locale)
+inline string formaterDate(Horodatage t) {
+    time_t brut = static_cast<time_t>(t);
+    char texte[16];
+    strftime(texte, sizeof(texte), "%Y-%m-%d", localtime(&brut));
+    return texte;
+}
+
+// Listes doublement chainees par indices dans un vecteur de noeuds: un noeud
+// peut appartenir a plusieurs listes, chacune avec sa paire de membres prec/suiv.
+constexpr uint32_t AUCUN_INDICE = numeric_limits<uint32_t>::max();
+
+struct ListeIndices {
+    uint32_t tete = AUCUN_INDICE;
+    uint32_t queue = AUCUN_INDICE;
+    uint32_t taille = 0;
+};
+
+template <auto Prec, auto Suiv, class Noeud>
+void chainerEnQueue(vector<Noeud>& noeuds, ListeIndices& l, uint32_t i) {
+    noeuds[i].*Prec = l.queue;
+    noeuds[i].*Suiv = AUCUN_INDICE;
+    if (l.queue != AUCUN_INDICE) noeuds[l.queue].*Suiv = i;
+    else l.tete = i;
+    l.queue = i;
+    l.taille++;
+}
+
+template <auto Prec, auto Suiv, class Noeud>
+void dechainer(vector<Noeud>& noeuds, ListeIndices& l, uint32_t i) {
+    uint32_t p = noeuds[i].*Prec, s = noeuds[i].*Suiv;
+    if (p != AUCUN_INDICE) noeuds[p].*Suiv = s;
+    else l.tete = s;
+    if (s != AUCUN_INDICE) noeuds[s].*Prec = p;
+    else l.queue = p;
+    l.taille--;
+}
+
+// Fichier en ajout seul, une ligne par operation, vide sur disque a chaque ecriture
+class JournalAjout {
+private:
+    string nom;
+    ofstream flux;
+    size_t lignes = 0;
+
+public:
+    void ouvrir(const string& fichier, size_t lignesExistantes) {
+        flux.close();
+        nom = fichier;
+        lignes = lignesExistantes;
+        flux.open(fichier, ios::app);
+    }
+
+    // Le tampon peut contenir plusieurs lignes: elles partent en une ecriture
+    void ecrire(const TamponEcriture& t) {
+        if (!flux.is_open()) return;
+        flux.write(t.contenu().data(), static_cast<streamsize>(t.contenu().size()));
+        flux.flush();
+        lignes += static_cast<size_t>(std::count(t.contenu().begin(), t.contenu().end(), '\n'));
+    }
+
+    // Remplace tout le journal (compactage) de facon atomique
+    bool reecrire(const string& contenu, size_t nbLignes) {
+        bool ouvert = flux.is_open();
+        flux.close();
+        bool ok = ecrireFichierAtomique(nom, contenu);
+        if (ok) lignes = nbLignes;
+        if (ouvert) flux.open(nom, ios::app);
+        return ok;
+    }
+
+    size_t nombreLignes() const { return lignes; }
+};
+
+struct Pret {
+    int idMedia;
+    Symbole emprunteur;
+    Horodatage debut;
+    Horodatage echeance;
+};
+
+class RegistrePrets {
+private:
+    struct Case {
+        Pret pret;
+        bool actif;
+        bool enRetard;
+        uint32_t generation;           // incremente a chaque liberation
+        uint32_t precUser, suivUser;   // prets du meme emprunteur
+        uint32_t precRetard, suivRetard;
+    };
+    struct Echeance {
+        Horodatage quand;
+        uint32_t indice;
+        uint32_t generation;
+        bool operator>(const Echeance& autre) const { return quand > autre.quand; }
+    };
+
+    vector<Case> cases;
+    vector<uint32_t> libres;
+    unordered_map<int, uint32_t> parMedia;
+    unordered_map<uint32_t, ListeIndices> parUser;   // cle: Symbole::id()
+    ListeIndices retards;                             // par echeance croissante
+    priority_queue<Echeance, vector<Echeance>, greater<Echeance>> tas;
+    size_t actifs = 0;
+
+    // Passe en retard les prets dont l'echeance est depassee (ordre croissant)
+    void avancer(Horodatage t) {
+        while (!tas.empty() && tas.top().quand <= t) {
+            Echeance e = tas.top();
+            tas.pop();
+            Case& c = cases[e.indice];
+            if (!c.actif || c.generation != e.generation) continue;   // rendu depuis
+            c.enRetard = true;
+            chainerEnQueue<&Case::precRetard, &Case::suivRetard>(cases, retards, e.indice);
+        }
+        // Trop d'entrees perimees: on reconstruit le tas avec les prets en cours
+        if (tas.size() > 2 * actifs + 1024) {
+            vector<Echeance> vivantes;
+            vivantes.reserve(actifs);
+            for (uint32_t i = 0; i < cases.size(); i++) {
+                if (cases[i].actif && !cases[i].enRetard) {
+                    vivantes.push_back({cases[i].pret.echeance, i, cases[i].generation});
+                }
+            }
+            tas = decltype(tas)(greater<Echeance>(), move(vivantes));
+        }
+    }
+
+public:
+    RegistrePrets() = default;
+    RegistrePrets(const RegistrePrets&) = delete;
+    RegistrePrets& operator=(const RegistrePrets&) = delete;
+
+    ~RegistrePrets() {
+        for (const auto& c : cases) {
+            if (c.actif) c.pret.emprunteur.conserver(-1);
+        }
+    }
+
+    bool emprunter(const Pret& pret) {
+        if (parMedia.count(pret.idMedia)) return false;
+        uint32_t i;
+        if (!libres.empty()) {
+            i = libres.back();
+            libres.pop_back();
+        } else {
+            i = static_cast<uint32_t>(cases.size());
+            cases.push_back(Case{pret, false, false, 0, AUCUN_INDICE, AUCUN_INDICE,
+                                 AUCUN_INDICE, AUCUN_INDICE});
+        }
+        Case& c = cases[i];
+        c.pret = pret;
+        c.pret.emprunteur.conserver(1);
+        c.actif = true;
+        c.enRetard = false;
+        parMedia.emplace(pret.idMedia, i);
+        chainerEnQueue<&Case::precUser, &Case::suivUser>(cases, parUser[pret.emprunteur.id()], i);
+        tas.push({pret.echeance, i, c.generation});
+        actifs++;
+        return true;
+    }
+
+    bool retourner(int idMedia) {
+        auto it = parMedia.find(idMedia);
+        if (it == parMedia.end()) return false;
+        uint32_t i = it->second;
+        Case& c = cases[i];
+        parMedia.erase(it);
+        auto liste = parUser.find(c.pret.emprunteur.id());
+        dechainer<&Case::precUser, &Case::suivUser>(cases, liste->second, i);
+        if (liste->second.taille == 0) parUser.erase(liste);
+        if (c.enRetard) dechainer<&Case::precRetard, &Case::suivRetard>(cases, retards, i);
+        c.pret.emprunteur.conserver(-1);
+        c.actif = false;
+        c.generation++;
+        libres.push_back(i);
+        actifs--;
+        return true;
+    }
+
+    const Pret* pretDe(int idMedia) const {
+        auto it = parMedia.find(idMedia);
+        return it == parMedia.end() ? nullptr : &cases[it->second].pret;
+    }
+
+    // Prets en cours d'un emprunteur, dans l'ordre d'emprunt
+    vector<const Pret*> pretsDe(Symbole emprunteur) const {
+        vector<const Pret*> resultat;
+        auto it = parUser.find(emprunteur.id());
+        if (it == parUser.end()) return resultat;
+        for (uint32_t i = it->second.tete; i != AUCUN_INDICE; i = cases[i].suivUser) {
+            resultat.push_back(&cases[i].pret);
+        }
+        return resultat;
+    }
+
+    // Prets echus a l'instant t, du plus ancien au plus recent
+    vector<const Pret*> enRetard(Horodatage t) {
+        avancer(t);
+        vector<const Pret*> resultat;
+        for (uint32_t i = retards.tete; i != AUCUN_INDICE; i = cases[i].suivRetard) {
+            resultat.push_back(&cases[i].pret);
+        }
+        return resultat;
+    }
+
+    template <class F>
+    void pourChaquePret(F&& f) const {
+        for (const auto& c : cases) {
+            if (c.actif) f(c.pret);
+        }
+    }
+
+    size_t nombreActifs() const { return actifs; }
+};
+
+// Files d'attente FIFO par media. Tous les noeuds (32 octets) sont dans un
+// seul vecteur avec liste de cases libres; chaque noeud
+// est chaine dans la file de son media et dans la liste de son lecteur.
+// Une table (media, lecteur) -> noeud donne reserver, servir et annuler en
+// O(1); seule position() parcourt la file jusqu'au lecteur.
+class FilesReservations {
+private:
+    struct Noeud {
+        int idMedia;
+        uint32_t precMedia, suivMedia;
+        uint32_t precLecteur, suivLecteur;
+        Symbole lecteur;
+    };
+
+    vector<Noeud> noeuds;
+    vector<uint32_t> libres;
+    unordered_map<int, ListeIndices> parMedia;
+    unordered_map<uint32_t, ListeIndices> parLecteur;   // cle: Symbole::id()
+    unordered_map<uint64_t, uint32_t> parCle;           // cle(media, lecteur) -> noeud
+    size_t total = 0;
+
+    static uint64_t cle(int idMedia, Symbole lecteur) {
+        return (static_cast<uint64_t>(static_cast<uint32_t>(idMedia)) << 32) | lecteur.id();
+    }
+
+    uint32_t chercher(int idMedia, Symbole lecteur) const {
+        auto it = parCle.find(cle(idMedia, lecteur));
+        return it == parCle.end() ? AUCUN_INDICE : it->second;
+    }
+
+    void enlever(uint32_t i) {
+        Noeud& n = noeuds[i];
+        auto file = parMedia.find(n.idMedia);
+        dechainer<&Noeud::precMedia, &Noeud::suivMedia>(noeuds, file->second, i);
+        if (file->second.taille == 0) parMedia.erase(file);
+        auto liste = parLecteur.find(n.lecteur.id());
+        dechainer<&Noeud::precLecteur, &Noeud::suivLecteur>(noeuds, liste->second, i);
+        if (liste->second.taille == 0) parLecteur.erase(liste);
+        parCle.erase(cle(n.idMedia, n.lecteur));
+        n.lecteur.conserver(-1);
+        libres.push_back(i);
+        total--;
+    }
+
+public:
+    FilesReservations() = default;
+    FilesReservations(const FilesReservations&) = delete;
+    FilesReservations& operator=(const FilesReservations&) = delete;
+
+    ~FilesReservations() {
+        for (const auto& [cle, i] : parCle) noeuds[i].lecteur.conserver(-1);
+    }
+
+    // Faux si le lecteur est deja dans la file
+    bool reserver(int idMedia, Symbole lecteur) {
+        auto [place, nouvelle] = parCle.try_emplace(cle(idMedia, lecteur), AUCUN_INDICE);
+        if (!nouvelle) return false;
+        uint32_t i;
+        if (!libres.empty()) {
+            i = libres.back();
+            libres.pop_back();
+            noeuds[i].idMedia = idMedia;
+            noeuds[i].lecteur = lecteur;
+        } else {
+            i = static_cast<uint32_t>(noeuds.size());
+            noeuds.push_back({idMedia, AUCUN_INDICE, AUCUN_INDICE, AUCUN_INDICE, AUCUN_INDICE, lecteur});
+        }
+        chainerEnQueue<&Noeud::precMedia, &Noeud::suivMedia>(noeuds, parMedia[idMedia], i);
+        chainerEnQueue<&Noeud::precLecteur, &Noeud::suivLecteur>(noeuds, parLecteur[lecteur.id()], i);
+        place->second = i;
+        lecteur.conserver(1);
+        total++;
+        return true;
+    }
+
+    bool annuler(int idMedia, Symbole lecteur) {
+        uint32_t i = chercher(idMedia, lecteur);
+        if (i == AUCUN_INDICE) return false;
+        enlever(i);
+        return true;
+    }
+
+    // Retire le premier de la file dans suivant; faux si la file est vide
+    bool servir(int idMedia, Symbole& suivant) {
+        auto file = parMedia.find(idMedia);
+        if (file == parMedia.end()) return false;
+        uint32_t i = file->second.tete;
+        suivant = noeuds[i].lecteur;
+        enlever(i);
+        return true;
+    }
+
+    size_t tailleFile(int idMedia) const {
+        auto file = parMedia.find(idMedia);
+        return file == parMedia.end() ? 0 : file->second.taille;
+    }
+
+    // Rang du lecteur dans la file (1 = prochain servi), 0 s'il n'y est pas.
+    // Cout proportionnel au rang.
+    size_t position(int idMedia, Symbole lecteur) const {
+        uint32_t i = chercher(idMedia, lecteur);
+        if (i == AUCUN_INDICE) return 0;
+        size_t rang = 1;
+        for (uint32_t p = noeuds[i].precMedia; p != AUCUN_INDICE; p = noeuds[p].precMedia) rang++;
+        return rang;
+    }
+
+    // Medias reserves par un lecteur, dans l'ordre des reservations
+    vector<int> reservationsDe(Symbole lecteur) const {
+        vector<int> resultat;
+        auto it = parLecteur.find(lecteur.id());
+        if (it == parLecteur.end()) return resultat;
+        for (uint32_t i = it->second.tete; i != AUCUN_INDICE; i = noeuds[i].suivLecteur) {
+            resultat.push_back(noeuds[i].idMedia);
+        }
+        return resultat;
+    }
+
+    // f(idMedia, lecteur) file par file, dans l'ordre de service
+    template <class F>
+    void pourChaqueReservation(F&& f) const {
+        for (const auto& [idMedia, file] : parMedia) {
+            for (uint32_t i = file.tete; i != AUCUN_INDICE; i = noeuds[i].suivMedia) {
+                f(idMedia, noeuds[i].lecteur);
+            }
+        }
+    }
+
+    size_t nombre() const { return total; }
+};
+
+// Prets et reservations partagent un journal (prets.txt), une ligne par
+// operation:
+//   E;id;lecteur;debut;echeance   emprunt
+//   R;id                          retour
+//   A;id;lecteur                  reservation
+//   C;id;lecteur                  annulation
+//   T;id;lecteur;debut;echeance   retour remis au premier de la file
+// La remise est une seule ligne: rejouee entierement ou pas du tout.
+class Circulation {
+private:
+    RegistrePrets prets;
+    FilesReservations reservations;
+    JournalAjout journal;
+
+    static void ecrireLigne(TamponEcriture& t, char op, const Pret& p) {
+        t << op << ';' << p.idMedia << ';' << p.emprunteur << ';'
+          << static_cast<long long>(p.debut) << ';' << static_cast<long long>(p.echeance) << '\n';
+    }
+
+    static void ecrireLigne(TamponEcriture& t, char op, int idMedia, Symbole lecteur) {
+        t << op << ';' << idMedia << ';' << lecteur << '\n';
+    }
+
+    void remettre(const Pret& pret) {
+        Symbole suivant;
+        reservations.servir(pret.idMedia, suivant);
+        prets.retourner(pret.idMedia);
+        prets.emprunter(pret);
+    }
+
+public:
+    // Rejoue le journal, le compacte s'il contient surtout des operations
+    // closes, puis l'ouvre en ajout
+    void charger(const string& fichier) {
+        ifstream f(fichier);
+        string ligne;
+        vector<string_view> champs;
+        size_t lignes = 0;
+        while (getline(f, ligne)) {
+            if (!ligne.empty() && ligne.back() == '\r') ligne.pop_back();
+            if (ligne.empty()) continue;
+            decouperChamps(ligne, champs);
+            lignes++;
+            char op = champs[0].empty() ? '?' : champs[0][0];
+            int id = champs.size() >= 2 ? lireEntier(champs[1]) : 0;
+            if ((op == 'E' || op == 'T') && champs.size() >= 5) {
+                Pret pret{id, Symbole(champs[2]), lireEntierLong(champs[3]), lireEntierLong(champs[4])};
+                if (op == 'T') remettre(pret);
+                else prets.emprunter(pret);
+            } else if (op == 'R') {
+                prets.retourner(id);
+            } else if (op == 'A' && champs.size() >= 3) {
+                reservations.reserver(id, Symbole(champs[2]));
+            } else if (op == 'C' && champs.size() >= 3) {
+                reservations.annuler(id, Symbole(champs[2]));
+            }
+        }
+        f.close();
+
+        journal.ouvrir(fichier, lignes);
+        if (lignes > 2 * (prets.nombreActifs() + reservations.nombre()) + 1024) compacter();
+    }
+
+    // Reecrit le journal avec les seuls prets et reservations en cours
+    void compacter() {
+        TamponEcriture t;
+        prets.pourChaquePret([&](const Pret& p) { ecrireLigne(t, 'E', p); });
+        reservations.pourChaqueReservation([&](int id, Symbole lecteur) { ecrireLigne(t, 'A', id, lecteur); });
+        journal.reecrire(t.contenu(), prets.nombreActifs() + reservations.nombre());
+    }
+
+    bool emprunter(const Pret& pret) {
+        if (!prets.emprunter(pret)) return false;
+        TamponEcriture t;
+        ecrireLigne(t, 'E', pret);
+        journal.ecrire(t);
+        return true;
+    }
+
+    bool retourner(int idMedia) {
+        if (!prets.retourner(idMedia)) return false;
+        TamponEcriture t;
+        t << "R;" << idMedia << '\n';
+        journal.ecrire(t);
+        return true;
+    }
+
+    // Retour d'un media reserve: le premier de la file en devient l'emprunteur
+    // sans que le media redevienne disponible. Faux si personne n'attend.
+    bool transmettre(int idMedia, Horodatage debut, Horodatage echeance, Symbole& suivant) {
+        if (!reservations.servir(idMedia, suivant)) return false;
+        prets.retourner(idMedia);
+        Pret pret{idMedia, suivant, debut, echeance};
+        prets.emprunter(pret);
+        TamponEcriture t;
+        ecrireLigne(t, 'T', pret);
+        journal.ecrire(t);
+        return true;
+    }
+
+    bool reserver(int idMedia, Symbole lecteur) {
+        if (!reservations.reserver(idMedia, lecteur)) return false;
+        TamponEcriture t;
+        ecrireLigne(t, 'A', idMedia, lecteur);
+        journal.ecrire(t);
+        return true;
+    }
+
+    bool annulerReservation(int idMedia, Symbole lecteur) {
+        if (!reservations.annuler(idMedia, lecteur)) return false;
+        TamponEcriture t;
+        ecrireLigne(t, 'C', idMedia, lecteur);
+        journal.ecrire(t);
+        return true;
+    }
+
+    // Media supprime du catalogue: pret clos et file videe
+    void oublierMedia(int idMedia) {
+        TamponEcriture t;
+        if (prets.retourner(idMedia)) t << "R;" << idMedia << '\n';
+        Symbole lecteur;
+        while (reservations.servir(idMedia, lecteur)) ecrireLigne(t, 'C', idMedia, lecteur);
+        if (t.taille() > 0) journal.ecrire(t);
+    }
+
+    RegistrePrets& registre() { return prets; }
+    const FilesReservations& files() const { return reservations; }
+};
+
+// ==========================================
+// ANALYSE DES EMPRUNTS (FLUX)
+// ==========================================
+// Popularite sans historique: chaque jour a son esquisse count-min (compte
+// approche de n'importe quel media) et son resume space-saving (les plus
+// empruntes du jour). Les fenetres "semaine" et "mois" additionnent les jours
+// concernes. Toutes les structures se fusionnent par simple addition, ce qui
+// permet d'alimenter une instance par fil puis de les reunir.
+
+// Compteurs approches: jamais sous-estimes, surestimes d'au plus
+// e/LARGEUR du total avec une forte probabilite.
+class EsquisseCountMin {
+public:
+    static constexpr size_t PROFONDEUR = 4;
+    static constexpr size_t LARGEUR = 1024;   // puissance de 2
+
+private:
+    uint32_t compteurs[PROFONDEUR][LARGEUR] = {};
+
+    static size_t colonne(int id, size_t ligne) {
+        uint64_t h = (static_cast<uint64_t>(static_cast<uint32_t>(id)) + 1) * 0x9E3779B97F4A7C15ull;
+        h ^= h >> 29;
+        h *= 0xBF58476D1CE4E5B9ull + 2 * ligne;
+        h ^= h >> 32;
+        return static_cast<size_t>(h) & (LARGEUR - 1);
+    }
+
+public:
+    void ajouter(int id, uint32_t n = 1) {
+        for (size_t l = 0; l < PROFONDEUR; l++) compteurs[l][colonne(id, l)] += n;
+    }
+
+    uint32_t estimer(int id) const {
+        uint32_t m = numeric_limits<uint32_t>::max();
+        for (size_t l = 0; l < PROFONDEUR; l++) m = min(m, compteurs[l][colonne(id, l)]);
+        return m;
+    }
+
+    void fusionner(const EsquisseCountMin& autre) {
+        for (size_t l = 0; l < PROFONDEUR; l++) {
+            for (size_t c = 0; c < LARGEUR; c++) compteurs[l][c] += autre.compteurs[l][c];
+        }
+    }
+
+    void vider() { memset(compteurs, 0, sizeof(compteurs)); }
+
+    // f(ligne, colonne, valeur) pour chaque compteur non nul (sauvegarde creuse)
+    template <class F>
+    void pourChaqueCompteur(F&& f) const {
+        for (size_t l = 0; l < PROFONDEUR; l++) {
+            for (size_t c = 0; c < LARGEUR; c++) {
+                if (compteurs[l][c]) f(l, c, compteurs[l][c]);
+            }
+        }
+    }
+
+    void fixer(size_t ligne, size_t col, uint32_t valeur) {
+        if (ligne < PROFONDEUR && col < LARGEUR) compteurs[ligne][col] = valeur;
+    }
+};
+
+// Space-saving: CAPACITE compteurs surveilles. Un nouveau venu remplace le plus
+// petit et herite de son compte (erreur = compte herite).
+class ResumeSpaceSaving {
+public:
+    static constexpr size_t CAPACITE = 64;
+
+    struct Compteur {
+        int id;
+        uint32_t compte;
+        uint32_t erreur;
+    };
+
+private:
+    vector<Compteur> compteurs;
+
+    Compteur* chercher(int id) {
+        for (auto& c : compteurs) {
+            if (c.id == id) return &c;
+        }
+        return nullptr;
+    }
+
+public:
+    void ajouter(int id, uint32_t n = 1, uint32_t erreur = 0) {
+        if (Compteur* c = chercher(id)) {
+            c->compte += n;
+            c->erreur += erreur;
+        } else if (compteurs.size() < CAPACITE) {
+            compteurs.push_back({id, n, erreur});
+        } else {
+            auto plusPetit = min_element(compteurs.begin(), compteurs.end(),
+                                         [](const Compteur& a, const Compteur& b) {
+                                             return a.compte < b.compte;
+                                         });
+            *plusPetit = {id, plusPetit->compte + n, plusPetit->compte + erreur};
+        }
+    }
+
+    void fusionner(const ResumeSpaceSaving& autre) {
+        for (const auto& c : autre.compteurs) ajouter(c.id, c.compte, c.erreur);
+    }
+
+    void vider() { compteurs.clear(); }
+    const vector<Compteur>& surveilles() const { return compteurs; }
+};
+
+struct Popularite {
+    int id;
+    uint32_t emprunts;   // estimation (count-min)
+    double tendance;     // rythme de la semaine / rythme des 3 semaines d'avant
+};
+
+class AnalyseEmprunts {
+public:
+    static constexpr size_t NB_JOURS = 32;
+
+private:
+    struct Jour {
+        long long numero = -1;   // jours depuis l'epoque (UTC), -1: vide
+        uint64_t total = 0;
+        EsquisseCountMin esquisse;
+        ResumeSpaceSaving resume;
+    };
+
+    vector<Jour> jours = vector<Jour>(NB_JOURS);   // anneau indexe par numero % NB_JOURS
+
+    static long long numeroJour(Horodatage t) { return t / SECONDES_PAR_JOUR; }
+
+    Jour& jour(long long numero) {
+        Jour& j = jours[static_cast<size_t>(numero) % NB_JOURS];
+        if (j.numero != numero) {
+            j.numero = numero;
+            j.total = 0;
+            j.esquisse.vider();
+            j.resume.vider();
+        }
+        return j;
+    }
+
+    // Somme des estimations sur les jours ]fin - nbJours, fin]
+    uint32_t estimer(int id, long long fin, long long nbJours) const {
+        uint32_t somme = 0;
+        for (const auto& j : jours) {
+            if (j.numero > fin - nbJours && j.numero <= fin) somme += j.esquisse.estimer(id);
+        }
+        return somme;
+    }
+
+public:
+    void enregistrer(int idMedia, Horodatage t) {
+        Jour& j = jour(numeroJour(t));
+        j.total++;
+        j.esquisse.ajouter(idMedia);
+        j.resume.ajouter(idMedia);
+    }
+
+    // Oublie tous les jours; les esquisses ne sont remises a zero qu'a leur
+    // prochaine utilisation (pas de reallocation)
+    void vider() {
+        for (auto& j : jours) j.numero = -1;
+    }
+
+    // Jour par jour: les deux anneaux doivent couvrir les memes dates
+    void fusionner(const AnalyseEmprunts& autre) {
+        for (const auto& j : autre.jours) {
+            if (j.numero < 0) continue;
+            Jour& mien = jours[static_cast<size_t>(j.numero) % NB_JOURS];
+            if (mien.numero > j.numero) continue;   // jour d'autre deja sorti de notre fenetre
+            Jour& cible = jour(j.numero);
+            cible.total += j.total;
+            cible.esquisse.fusionner(j.esquisse);
+            cible.resume.fusionner(j.resume);
+        }
+    }
+
+    // Les n plus empruntes sur les nbJours jours finissant a t. Les candidats
+    // viennent des resumes space-saving; leurs comptes sont estimes par count-min.
+    vector<Popularite> plusEmpruntes(size_t n, long long nbJours, Horodatage t) const {
+        long long fin = numeroJour(t);
+        unordered_map<int, uint32_t> candidats;
+        for (const auto& j : jours) {
+            if (j.numero <= fin - nbJours || j.numero > fin) continue;
+            for (const auto& c : j.resume.surveilles()) candidats[c.id] += c.compte;
+        }
+
+        // Bornes hautes space-saving: on n'affine que les 2n plus prometteurs
+        vector<pair<uint32_t, int>> ordre;
+        ordre.reserve(candidats.size());
+        for (const auto& [id, compte] : candidats) ordre.push_back({compte, id});
+        size_t garde = min(ordre.size(), 2 * n);
+        partial_sort(ordre.begin(), ordre.begin() + garde, ordre.end(), greater<pair<uint32_t, int>>());
+
+        vector<Popularite> resultat;
+        for (size_t i = 0; i < garde; i++) {
+            int id = ordre[i].second;
+            resultat.push_back({id, min(ordre[i].first, estimer(id, fin, nbJours)), 0.0});
+        }
+        sort(resultat.begin(), resultat.end(), [](const Popularite& a, const Popularite& b) {
+            return a.emprunts != b.emprunts ? a.emprunts > b.emprunts : a.id < b.id;
+        });
+        if (resultat.size() > n) resultat.resize(n);
+        return resultat;
+    }
+
+    // Medias dont le rythme de la semaine depasse celui des 3 semaines precedentes
+    vector<Popularite> tendances(size_t n, Horodatage t) const {
+        long long fin = numeroJour(t);
+        vector<Popularite> resultat = plusEmpruntes(4 * n, 7, t);
+        for (auto& p : resultat) {
+            double avant = estimer(p.id, fin - 7, 21) / 3.0;
+            p.tendance = p.emprunts / max(1.0, avant);
+        }
+        resultat.erase(remove_if(resultat.begin(), resultat.end(),
+                                 [](const Popularite& p) { return p.tendance <= 1.0; }),
+                       resultat.end());
+        sort(resultat.begin(), resultat.end(), [](const Popularite& a, const Popularite& b) {
+            return a.tendance != b.tendance ? a.tendance > b.tendance : a.emprunts > b.emprunts;
+        });
+        if (resultat.size() > n) resultat.resize(n);
+        return resultat;
+    }
+
+    uint64_t total(long long nbJours, Horodatage t) const {
+        long long fin = numeroJour(t);
+        uint64_t somme = 0;
+        for (const auto& j : jours) {
+            if (j.numero > fin - nbJours && j.numero <= fin) somme += j.total;
+        }
+        return somme;
+    }
+
+    // Format texte creux, un jour par bloc:
+    //   J;numero;total / S;id;compte;erreur / C;ligne;colonne;valeur
+    void ecrire(TamponEcriture& t) const {
+        for (const auto& j : jours) {
+            if (j.numero < 0) continue;
+            t << "J;" << j.numero << ';' << static_cast<size_t>(j.total) << '\n';
+            for (const auto& c : j.resume.surveilles()) {
+                t << "S;" << c.id << ';' << static_cast<size_t>(c.compte) << ';'
+                  << static_cast<size_t>(c.erreur) << '\n';
+            }
+            j.esquisse.pourChaqueCompteur([&t](size_t l, size_t c, uint32_t v) {
+                t << "C;" << l << ';' << c << ';' << static_cast<size_t>(v) << '\n';
+            });
+        }
+    }
+
+    void charger(const string& fichier) {
+        ifstream f(fichier);
+        string ligne;
+        vector<string_view> champs;
+        Jour* courant = nullptr;
+        while (getline(f, ligne)) {
+            decouperChamps(ligne, champs);
+            if (champs.size() < 3) continue;
+            if (champs[0] == "J") {
+                long long numero = lireEntierLong(champs[1]);
+                courant = numero >= 0 ? &jour(numero) : nullptr;
+                if (courant) courant->total = static_cast<uint64_t>(lireEntierLong(champs[2]));
+            } else if (!courant) {
+                continue;
+            } else if (champs[0] == "S" && champs.size() >= 4) {
+                courant->resume.ajouter(lireEntier(champs[1]), static_cast<uint32_t>(lireEntierLong(champs[2])),
+                                        static_cast<uint32_t>(lireEntierLong(champs[3])));
+            } else if (champs[0] == "C" && champs.size() >= 4) {
+                courant->esquisse.fixer(static_cast<size_t>(lireEntier(champs[1])),
+                                        static_cast<size_t>(lireEntier(champs[2])),
+                                        static_cast<uint32_t>(lireEntierLong(champs[3])));
+            }
+        }
+    }
+};
+
+// ==========================================
+// RAPPORTS PARALLELES
+// ==========================================
+// Fils de travail crees une fois. executer(n, f) repartit les taches 0..n-1
+// entre les fils (l'appelant compris) et rend la main quand toutes sont
+// finies. Un seul lot a la fois.
+class PoolFils {
+private:
+    vector<thread> fils;
+    mutex verrou;
+    condition_variable reveil;
+    condition_variable fin;
+    function<void(size_t, size_t)> tache;   // (indice de tache, indice de fil)
+    size_t nbTaches = 0;
+    atomic<size_t> prochaine{0};
+    size_t enCours = 0;
+    uint64_t lot = 0;
+    bool arret = false;
+
+    void executerTaches(size_t fil) {
+        for (size_t i = prochaine++; i < nbTaches; i = prochaine++) tache(i, fil);
+    }
+
+    void travailler(size_t fil) {
+        uint64_t vu = 0;
+        unique_lock<mutex> garde(verrou);
+        while (true) {
+            reveil.wait(garde, [&] { return arret || lot != vu; });
+            if (arret) return;
+            vu = lot;
+            garde.unlock();
+            executerTaches(fil);
+            garde.lock();
+            if (--enCours == 0) fin.notify_one();
+        }
+    }
+
+public:
+    explicit PoolFils(size_t nombre) {
+        for (size_t f = 1; f < max<size_t>(1, nombre); f++) {
+            fils.emplace_back([this, f]() { travailler(f); });
+        }
+    }
+
+    PoolFils(const PoolFils&) = delete;
+    PoolFils& operator=(const PoolFils&) = delete;
+
+    ~PoolFils() {
+        {
+            lock_guard<mutex> garde(verrou);
+            arret = true;
+        }
+        reveil.notify_all();
+        for (auto& f : fils) f.join();
+    }
+
+    static PoolFils& global() {
+        static PoolFils pool(thread::hardware_concurrency());
+        return pool;
+    }
+
+    size_t taille() const { return fils.size() + 1; }
+
+    void executer(size_t n, function<void(size_t, size_t)> f) {
+        {
+            lock_guard<mutex> garde(verrou);
+            tache = move(f);
+            nbTaches = n;
+            prochaine = 0;
+            enCours = fils.size();
+            lot++;
+        }
+        reveil.notify_all();
+        executerTaches(0);
+        unique_lock<mutex> garde(verrou);
+        fin.wait(garde, [&] { return enCours == 0; });
+    }
+};
+
+// Totaux d'un groupe (type, auteur, qualite, format...)
+struct TotauxGroupe {
+    uint64_t nombre = 0;
+    uint64_t dispo = 0;
+    long long duree = 0;
+    long long pages = 0;
+    double tailleMo = 0.0;
+
+    void fusionner(const TotauxGroupe& autre) {
+        nombre += autre.nombre;
+        dispo += autre.dispo;
+        duree += autre.duree;
+        pages += autre.pages;
+        tailleMo += autre.tailleMo;
+    }
+};
+
+// Bornes basses des classes des histogrammes
+constexpr int BORNES_DUREE[] = {0, 30, 60, 90, 120, 180};
+constexpr double BORNES_TAILLE[] = {0.0, 1.0, 5.0, 20.0, 100.0};
+constexpr size_t NB_CLASSES_DUREE = size(BORNES_DUREE);
+constexpr size_t NB_CLASSES_TAILLE = size(BORNES_TAILLE);
+
+// Accumulateur d'un fil; les fils ne partagent rien jusqu'a la fusion finale
+struct AccumulateurRapport {
+    array<TotauxGroupe, NB_TYPES_MEDIA> parType;
+    unordered_map<string_view, TotauxGroupe> parAuteur;
+    array<unordered_map<string_view, TotauxGroupe>, NB_TYPES_MEDIA> parGroupe;
+    array<uint64_t, NB_CLASSES_DUREE> histoDuree{};
+    array<uint64_t, NB_CLASSES_TAILLE> histoTaille{};
+
+    void fusionner(const AccumulateurRapport& autre) {
+        for (size_t t = 0; t < NB_TYPES_MEDIA; t++) {
+            parType[t].fusionner(autre.parType[t]);
+            for (const auto& [cle, totaux] : autre.parGroupe[t]) parGroupe[t][cle].fusionner(totaux);
+        }
+        for (const auto& [cle, totaux] : autre.parAuteur) parAuteur[cle].fusionner(totaux);
+        for (size_t c = 0; c < NB_CLASSES_DUREE; c++) histoDuree[c] += autre.histoDuree[c];
+        for (size_t c = 0; c < NB_CLASSES_TAILLE; c++) histoTaille[c] += autre.histoTaille[c];
+    }
+};
+
+// Les valeurs numeriques sont rangees par colonnes, BLOC lignes a la fois:
+// les reductions ci-dessous sont des boucles sans branche sur des tableaux
+// contigus, que le compilateur vectorise.
+class BlocRapport {
+public:
+    static constexpr size_t BLOC = 256;
+
+private:
+    size_t n = 0;
+    uint8_t type[BLOC];
+    uint8_t dispo[BLOC];
+    int32_t duree[BLOC];
+    int32_t pages[BLOC];
+    double tailleMo[BLOC];
+
+public:
+    bool plein() const { return n == BLOC; }
+
+    void ajouter(const LigneRapport& r) {
+        type[n] = static_cast<uint8_t>(r.type);
+        dispo[n] = r.dispo;
+        duree[n] = r.duree;
+        pages[n] = r.pages;
+        tailleMo[n] = r.tailleMo;
+        n++;
+    }
+
+    void reduire(AccumulateurRapport& acc) {
+        for (uint8_t t = 0; t < NB_TYPES_MEDIA; t++) {
+            uint64_t nombre = 0, nbDispo = 0;
+            long long sDuree = 0, sPages = 0;
+            double sTaille = 0.0;
+            for (size_t k = 0; k < n; k++) {
+                uint32_t m = type[k] == t;
+                nombre += m;
+                nbDispo += m & dispo[k];
+                sDuree += m ? duree[k] : 0;
+                sPages += m ? pages[k] : 0;
+                sTaille += m ? tailleMo[k] : 0.0;
+            }
+            TotauxGroupe& g = acc.parType[t];
+            g.nombre += nombre;
+            g.dispo += nbDispo;
+            g.duree += sDuree;
+            g.pages += sPages;
+            g.tailleMo += sTaille;
+        }
+
+        // Classe = nombre de bornes depassees (0 pour les medias sans duree/taille)
+        uint8_t classe[BLOC];
+        for (size_t k = 0; k < n; k++) {
+            uint8_t c = 0;
+            for (size_t b = 1; b < NB_CLASSES_DUREE; b++) c += duree[k] >= BORNES_DUREE[b];
+            classe[k] = c;
+        }
+        for (size_t k = 0; k < n; k++) {
+            if (duree[k] > 0) acc.histoDuree[classe[k]]++;
+        }
+        for (size_t k = 0; k < n; k++) {
+            uint8_t c = 0;
+            for (size_t b = 1; b < NB_CLASSES_TAILLE; b++) c += tailleMo[k] >= BORNES_TAILLE[b];
+            classe[k] = c;
+        }
+        for (size_t k = 0; k < n; k++) {
+            if (tailleMo[k] > 0) acc.histoTaille[classe[k]]++;
+        }
+        n = 0;
+    }
+};
+
+// Agrege n enregistrements. lire(i, champs, ligne) remplit la LigneRapport du
+// i-eme (champs: tampon de decoupage propre au fil). Le catalogue est coupe
+// en tranches distribuees dynamiquement; chaque fil accumule dans ses propres
+// tables, fusionnees a la fin.
+template <class Lecteur>
+AccumulateurRapport agregerEnParallele(PoolFils& pool, size_t n, const Lecteur& lire) {
+    const size_t nbFils = pool.taille();
+    const size_t nbTranches = min(n, nbFils * 8) + 1;
+    vector<AccumulateurRapport> parFil(nbFils);
+
+    pool.executer(nbTranches, [&](size_t tranche, size_t fil) {
+        size_t debut = n * tranche / nbTranches;
+        size_t fin = n * (tranche + 1) / nbTranches;
+        AccumulateurRapport& acc = parFil[fil];
+        vector<string_view> champs;
+        BlocRapport bloc;
+        for (size_t i = debut; i < fin; i++) {
+            LigneRapport r{TypeMedia::Livre, false, {}, {}, 0, 0, 0.0};
+            lire(i, champs, r);
+            bloc.ajouter(r);
+            if (bloc.plein()) bloc.reduire(acc);
+            if (!r.auteur.empty()) {
+                TotauxGroupe& g = acc.parAuteur[r.auteur];
+                g.nombre++;
+                g.dispo += r.dispo;
+            }
+            if (!r.groupe.empty()) {
+                TotauxGroupe& g = acc.parGroupe[static_cast<size_t>(r.type)][r.groupe];
+                g.nombre++;
+                g.dispo += r.dispo;
+            }
+        }
+        bloc.reduire(acc);
+    });
+
+    for (size_t f = 1; f < nbFils; f++) parFil[0].fusionner(parFil[f]);
+    return move(parFil[0]);
+}
+
+// ==========================================
+// LANGAGE DE REQUETES
+// ==========================================
+// Syntaxe:  [EXPLAIN] expr
+//   expr     := terme (OR terme)*          (OU accepte)
+//   terme    := facteur (AND facteur)*     (ET accepte)
+//   facteur  := NOT facteur | ( expr ) | champ op valeur | dispo
+//   op       := = != < <= > >= ~           (~ : contient, sans casse ni accents)
+// Exemple:  type=Video AND duree>=90 AND titre~"star" AND dispo
+// Un champ propre a certains types (duree, auteur, format...) est faux pour
+// les autres types.
+enum class ChampRequete { Id, Type, Dispo, Titre, Auteur, Duree, Pages, Taille, Qualite, Format, Publicateur };
+enum class OpRequete { Egal, Different, Inferieur, InferieurEgal, Superieur, SuperieurEgal, Contient };
+
+struct DefinitionChamp {
+    const char* nom;
+    ChampRequete champ;
+    bool numerique;
+    bool enTete;   // lu sans decoder la ligne (id, type, dispo)
+    int coutEval;  // cout relatif d'evaluation
+};
+
+const DefinitionChamp CHAMPS_REQUETE[] = {
+    {"id", ChampRequete::Id, true, true, 1},
+    {"type", ChampRequete::Type, false, true, 1},
+    {"dispo", ChampRequete::Dispo, false, true, 1},
+    {"titre", ChampRequete::Titre, false, false, 15},
+    {"auteur", ChampRequete::Auteur, false, false, 12},
+    {"duree", ChampRequete::Duree, true, false, 10},
+    {"pages", ChampRequete::Pages, true, false, 10},
+    {"taille", ChampRequete::Taille, true, false, 10},
+    {"qualite", ChampRequete::Qualite, false, false, 12},
+    {"format", ChampRequete::Format, false, false, 12},
+    {"publicateur", ChampRequete::Publicateur, false, false, 12},   // editeur (Audio) ou voix (AudioBook)
+};
+
+const char* const NOMS_OPS[] = {"=", "!=", "<", "<=", ">", ">=", "~"};
+
+// Le champ existe-t-il pour ce type de media ?
+inline bool champApplicable(ChampRequete champ, TypeMedia type) {
+    const OperationsMedia& ops = operations(type);
+    switch (champ) {
+        case ChampRequete::Auteur:
+        case ChampRequete::Pages:       return ops.estLivre;
+        case ChampRequete::Duree:       return ops.aDuree;
+        case ChampRequete::Taille:
+        case ChampRequete::Format:      return type == TypeMedia::Ebook;
+        case ChampRequete::Qualite:     return type == TypeMedia::Video;
+        case ChampRequete::Publicateur: return type == TypeMedia::Audio || type == TypeMedia::AudioBook;
+        default:                        return true;
+    }
+}
+
+struct NoeudRequete {
+    enum class Genre { Et, Ou, Non, Predicat };
+    Genre genre;
+    vector<unique_ptr<NoeudRequete>> enfants;
+
+    // Predicat
+    const DefinitionChamp* champ = nullptr;
+    OpRequete op = OpRequete::Egal;
+    string texte;        // valeur normalisee (champs texte)
+    double nombre = 0;   // valeur (champs numeriques, dispo)
+    TypeMedia typeValeur = TypeMedia::Livre;
+
+    // Estimations du planificateur
+    double selectivite = 1.0;
+    double coutEval = 0.0;
+};
+
+// Decompte utilise pour estimer la selectivite des predicats
+struct ProfilCatalogue {
+    size_t total = 0;
+    array<size_t, NB_TYPES_MEDIA> parType{};
+    double fractionDispo = 0.5;
+};
+
+class AnalyseurRequete {
+private:
+    enum class Jeton { Mot, Chaine, Op, ParOuvrante, ParFermante, Fin };
+
+    string_view source;
+    size_t pos = 0;
+    Jeton jeton = Jeton::Fin;
+    string valeur;   // texte du jeton courant
+    string erreur;
+
+    void avancer() {
+        while (pos < source.size() && isspace(static_cast<unsigned char>(source[pos]))) pos++;
+        valeur.clear();
+        if (pos >= source.size()) {
+            jeton = Jeton::Fin;
+            return;
+        }
+        char c = source[pos];
+        if (c == '(' || c == ')') {
+            jeton = c == '(' ? Jeton::ParOuvrante : Jeton::ParFermante;
+            valeur = c;
+            pos++;
+        } else if (c == '"') {
+            size_t fin = source.find('"', pos + 1);
+            if (fin == string_view::npos) {
+                if (erreur.empty()) erreur = "guillemet non ferme";
+                fin = source.size();
+            }
+            jeton = Jeton::Chaine;
+            valeur = string(source.substr(pos + 1, fin - pos - 1));
+            pos = min(fin + 1, source.size());
+        } else if (strchr("=!<>~", c)) {
+            jeton = Jeton::Op;
+            valeur = c;
+            pos++;
+            if (pos < source.size() && source[pos] == '=' && c != '=' && c != '~') valeur += source[pos++];
+        } else {
+            jeton = Jeton::Mot;
+            while (pos < source.size() && !isspace(static_cast<unsigned char>(source[pos]))
+                   && !strchr("()\"=!<>~", source[pos])) {
+                valeur += source[pos++];
+            }
+        }
+    }
+
+    bool motCle(const char* a, const char* b) const {
+        if (jeton != Jeton::Mot) return false;
+        string m = normaliserCle(valeur);
+        return m == a || m == b;
+    }
+
+    unique_ptr<NoeudRequete> echec(const string& message) {
+        if (erreur.empty()) erreur = message;
+        return nullptr;
+    }
+
+    static unique_ptr<NoeudRequete> noeud(NoeudRequete::Genre genre) {
+        auto n = make_unique<NoeudRequete>();
+        n->genre = genre;
+        return n;
+    }
+
+    unique_ptr<NoeudRequete> lireExpression() {
+        auto gauche = lireTerme();
+        if (!gauche) return nullptr;
+        if (!motCle("or", "ou")) return gauche;
+        auto ou = noeud(NoeudRequete::Genre::Ou);
+        ou->enfants.push_back(move(gauche));
+        while (motCle("or", "ou")) {
+            avancer();
+            auto droite = lireTerme();
+            if (!droite) return nullptr;
+            ou->enfants.push_back(move(droite));
+        }
+        return ou;
+    }
+
+    unique_ptr<NoeudRequete> lireTerme() {
+        auto gauche = lireFacteur();
+        if (!gauche) return nullptr;
+        if (!motCle("and", "et")) return gauche;
+        auto et = noeud(NoeudRequete::Genre::Et);
+        et->enfants.push_back(move(gauche));
+        while (motCle("and", "et")) {
+            avancer();
+            auto droite = lireFacteur();
+            if (!droite) return nullptr;
+            et->enfants.push_back(move(droite));
+        }
+        return et;
+    }
+
+    unique_ptr<NoeudRequete> lireFacteur() {
+        if (motCle("not", "non")) {
+            avancer();
+            auto interne = lireFacteur();
+            if (!interne) return nullptr;
+            auto non = noeud(NoeudRequete::Genre::Non);
+            non->enfants.push_back(move(interne));
+            return non;
+        }
+        if (jeton == Jeton::ParOuvrante) {
+            avancer();
+            auto interne = lireExpression();
+            if (!interne) return nullptr;
+            if (jeton != Jeton::ParFermante) return echec("')' attendue");
+            avancer();
+            return interne;
+        }
+        return lirePredicat();
+    }
+
+    unique_ptr<NoeudRequete> lirePredicat() {
+        if (jeton != Jeton::Mot) return echec("champ attendu pres de '" + valeur + "'");
+        string nom = normaliserCle(valeur);
+        const DefinitionChamp* def = nullptr;
+        for (const auto& d : CHAMPS_REQUETE) {
+            if (nom == d.nom) def = &d;
+        }
+        if (!def) return echec("champ inconnu '" + valeur + "'");
+        avancer();
+
+        auto p = noeud(NoeudRequete::Genre::Predicat);
+        p->champ = def;
+        if (jeton != Jeton::Op) {
+            if (def->champ != ChampRequete::Dispo) return echec("operateur attendu apres '" + string(def->nom) + "'");
+            p->nombre = 1;   // "dispo" seul
+            return p;
+        }
+
+        size_t iop = 0;
+        while (iop < size(NOMS_OPS) && valeur != NOMS_OPS[iop]) iop++;
+        if (iop == size(NOMS_OPS)) return echec("operateur inconnu '" + valeur + "'");
+        p->op = static_cast<OpRequete>(iop);
+        avancer();
+        if (jeton != Jeton::Mot && jeton != Jeton::Chaine) return echec("valeur attendue apres l'operateur");
+        string brut = valeur;
+        avancer();
+
+        bool egalite = p->op == OpRequete::Egal || p->op == OpRequete::Different;
+        if (def->champ == ChampRequete::Dispo) {
+            string v = normaliserCle(brut);
+            if (!egalite) return echec("dispo s'utilise avec = ou !=");
+            if (v == "1" || v == "oui" || v == "vrai") p->nombre = 1;
+            else if (v == "0" || v == "non" || v == "faux") p->nombre = 0;
+            else return echec("dispo vaut oui ou non");
+        } else if (def->champ == ChampRequete::Type) {
+            if (!egalite) return echec("type s'utilise avec = ou !=");
+            string v = normaliserCle(brut);
+            bool trouve = false;
+            for (const auto& ops : REGISTRE_MEDIA) {
+                if (normaliserCle(ops.nom) == v) {
+                    p->typeValeur = ops.type;
+                    trouve = true;
+                }
+            }
+            if (!trouve) return echec("type inconnu '" + brut + "'");
+        } else if (def->numerique) {
+            if (p->op == OpRequete::Contient) return echec("~ ne s'applique qu'au texte");
+            auto res = from_chars(brut.data(), brut.data() + brut.size(), p->nombre);
+            if (res.ec != errc() || res.ptr != brut.data() + brut.size()) {
+                return echec("nombre attendu pour " + string(def->nom));
+            }
+        } else {
+            if (!egalite && p->op != OpRequete::Contient) return echec("comparaison < > impossible sur du texte");
+            p->texte = normaliserCle(brut);
+        }
+        return p;
+    }
+
+public:
+    bool explain = false;
+
+    // Arbre de la requete, ou nullptr (voir getErreur)
+    unique_ptr<NoeudRequete> analyser(string_view texte) {
+        source = texte;
+        pos = 0;
+        erreur.clear();
+        avancer();
+        explain = motCle("explain", "expliquer");
+        if (explain) avancer();
+        if (jeton == Jeton::Fin) return echec("requete vide");
+        auto racine = lireExpression();
+        if (racine && jeton != Jeton::Fin) return echec("texte inattendu pres de '" + valeur + "'");
+        return racine;
+    }
+
+    const string& getErreur() const { return erreur; }
+};
+
+// Estime selectivite et cout de chaque noeud, puis ordonne les enfants:
+// ET d'abord le meilleur rapport cout / (1 - selectivite) (elimine vite),
+// OU d'abord le meilleur rapport cout / selectivite (accepte vite).
+void planifierNoeud(NoeudRequete& n, const ProfilCatalogue& profil) {
+    using Genre = NoeudRequete::Genre;
+    if (n.genre == Genre::Predicat) {
+        const double total = max<size_t>(1, profil.total);
+        double s;
+        switch (n.champ->champ) {
+            case ChampRequete::Id:
+                s = n.op == OpRequete::Egal ? 1.0 / total : n.op == OpRequete::Different ? 1.0 : 0.3;
+                break;
+            case ChampRequete::Type:
+                s = profil.parType[static_cast<size_t>(n.typeValeur)] / total;
+                if (n.op == OpRequete::Different) s = 1.0 - s;
+                break;
+            case ChampRequete::Dispo:
+                s = (n.nombre != 0) == (n.op == OpRequete::Egal) ? profil.fractionDispo : 1.0 - profil.fractionDispo;
+                break;
+            default: {
+                // Part des medias pour lesquels le champ existe, puis forme du test
+                size_t applicables = 0;
+                for (size_t t = 0; t < NB_TYPES_MEDIA; t++) {
+                    if (champApplicable(n.champ->champ, static_cast<TypeMedia>(t))) applicables += profil.parType[t];
+                }
+                double part = applicables / total;
+                double forme = n.op == OpRequete::Egal ? (n.champ->numerique ? 0.01 : 0.05)
+                             : n.op == OpRequete::Different ? 0.95
+                             : n.op == OpRequete::Contient ? 0.1 : 0.33;
+                s = part * forme;
+            }
+        }
+        n.selectivite = min(1.0, max(0.0, s));
+        n.coutEval = n.champ->coutEval;
+        return;
+    }
+
+    for (auto& e : n.enfants) planifierNoeud(*e, profil);
+    if (n.genre == Genre::Non) {
+        n.selectivite = 1.0 - n.enfants[0]->selectivite;
+        n.coutEval = n.enfants[0]->coutEval;
+        return;
+    }
+
+    bool et = n.genre == Genre::Et;
+    auto rang = [et](const unique_ptr<NoeudRequete>& e) {
+        double utile = et ? 1.0 - e->selectivite : e->selectivite;
+        return e->coutEval / max(utile, 1e-9);
+    };
+    stable_sort(n.enfants.begin(), n.enfants.end(),
+                [&rang](const auto& a, const auto& b) { return rang(a) < rang(b); });
+
+    // Cout attendu avec court-circuit: un enfant n'est evalue que si les precedents n'ont pas conclu
+    double passe = 1.0, total = 0.0;
+    for (const auto& e : n.enfants) {
+        total += passe * e->coutEval;
+        passe *= et ? e->selectivite : 1.0 - e->selectivite;
+    }
+    n.coutEval = total;
+    n.selectivite = et ? passe : 1.0 - passe;
+}
+
+void decrireNoeud(const NoeudRequete& n, ostream& os, int profondeur) {
+    using Genre = NoeudRequete::Genre;
+    os << string(2 * profondeur + 4, ' ');
+    if (n.genre == Genre::Predicat) {
+        os << n.champ->nom;
+        if (n.champ->champ == ChampRequete::Dispo) os << ' ' << NOMS_OPS[static_cast<size_t>(n.op)] << ' ' << (n.nombre != 0 ? "oui" : "non");
+        else if (n.champ->champ == ChampRequete::Type) os << ' ' << NOMS_OPS[static_cast<size_t>(n.op)] << ' ' << operations(n.typeValeur).nom;
+        else if (n.champ->numerique) os << ' ' << NOMS_OPS[static_cast<size_t>(n.op)] << ' ' << n.nombre;
+        else os << ' ' << NOMS_OPS[static_cast<size_t>(n.op)] << " \"" << n.texte << '"';
+    } else {
+        os << (n.genre == Genre::Et ? "ET" : n.genre == Genre::Ou ? "OU" : "NON");
+    }
+    os << "   (selectivite ~" << fixed << setprecision(n.selectivite < 0.01 ? 4 : 2) << n.selectivite * 100
+       << "%, cout " << setprecision(1) << n.coutEval << ")" << defaultfloat << setprecision(6) << endl;
+    for (const auto& e : n.enfants) decrireNoeud(*e, os, profondeur + 1);
+}
+
+// Evalue l'arbre avec court-circuit. Ctx fournit id(), type(), dispo(),
+// valeurs() (LigneRapport, decodee a la demande), cleTitre() et
+// normaliser(texte) (cle dans un tampon du contexte).
+template <class Ctx>
+bool evaluerNoeud(const NoeudRequete& n, Ctx& ctx) {
+    using Genre = NoeudRequete::Genre;
+    switch (n.genre) {
+        case Genre::Et:
+            for (const auto& e : n.enfants) {
+                if (!evaluerNoeud(*e, ctx)) return false;
+            }
+            return true;
+        case Genre::Ou:
+            for (const auto& e : n.enfants) {
+                if (evaluerNoeud(*e, ctx)) return true;
+            }
+            return false;
+        case Genre::Non:
+            return !evaluerNoeud(*n.enfants[0], ctx);
+        default:
+            break;
+    }
+
+    auto comparer = [&n](double v) {
+        switch (n.op) {
+            case OpRequete::Egal:          return v == n.nombre;
+            case OpRequete::Different:     return v != n.nombre;
+            case OpRequete::Inferieur:     return v < n.nombre;
+            case OpRequete::InferieurEgal: return v <= n.nombre;
+            case OpRequete::Superieur:     return v > n.nombre;
+            case OpRequete::SuperieurEgal: return v >= n.nombre;
+            default:                       return false;
+        }
+    };
+    auto comparerTexte = [&n](string_view cle) {
+        switch (n.op) {
+            case OpRequete::Egal:      return cle == n.texte;
+            case OpRequete::Different: return cle != n.texte;
+            default:                   return cle.find(n.texte) != string_view::npos;
+        }
+    };
+
+    ChampRequete champ = n.champ->champ;
+    switch (champ) {
+        case ChampRequete::Id:    return comparer(ctx.id());
+        case ChampRequete::Type:  return (ctx.type() == n.typeValeur) == (n.op == OpRequete::Egal);
+        case ChampRequete::Dispo: return comparer(ctx.dispo() ? 1 : 0);
+        case ChampRequete::Titre: return comparerTexte(ctx.cleTitre());
+        default:
+            break;
+    }
+    if (!champApplicable(champ, ctx.type())) return false;
+    const LigneRapport& v = ctx.valeurs();
+    switch (champ) {
+        case ChampRequete::Duree:  return comparer(v.duree);
+        case ChampRequete::Pages:  return comparer(v.pages);
+        case ChampRequete::Taille: return comparer(v.tailleMo);
+        case ChampRequete::Auteur: return comparerTexte(ctx.normaliser(v.auteur));
+        default:                   return comparerTexte(ctx.normaliser(v.groupe));
+    }
+}
+
+// Compte rendu d'une execution, pour cumuler celles de plusieurs partitions
+struct BilanRequete {
+    size_t trouves = 0;
+    size_t examinees = 0;
+    bool tronque = false;
+    bool explain = false;   // seul le plan a ete affiche
+};
+
+// ==========================================
+// DETECTION DES DOUBLONS (MINHASH / LSH)
+// ==========================================
+// Le texte compare (titre et auteur, normalises) est decoupe en trigrammes
+// de caracteres. Sa signature MinHash de NB_HASH minimums est coupee en
+// NB_BANDES bandes: deux medias qui tombent dans le meme seau pour au moins
+// une bande sont candidats, puis retenus si la similarite de Jaccard exacte
+// de leurs trigrammes atteint le seuil. Avec 12 bandes de 4 minimums, deux
+// textes similaires a 60% sont candidats ~81% du temps, a 70% ~96%.
+class IndexDoublons {
+public:
+    static constexpr size_t NB_HASH = 48;
+    static constexpr size_t NB_BANDES = 12;
+    static constexpr size_t LIGNES_PAR_BANDE = NB_HASH / NB_BANDES;
+    using Cles = array<uint32_t, NB_BANDES>;
+
+    struct Entree {
+        uint32_t cle;
+        int id;
+        bool operator<(const Entree& autre) const { return cle != autre.cle ? cle < autre.cle : id < autre.id; }
+    };
+    using Bandes = array<vector<Entree>, NB_BANDES>;
+
+private:
+    Bandes seaux;                                                 // tries par cle (construction en lot)
+    array<vector<bool>, NB_BANDES> retires;                       // entrees de seaux supprimees depuis
+    size_t nbRetires = 0;
+    array<unordered_multimap<uint32_t, int>, NB_BANDES> ajouts;   // medias ajoutes depuis
+
+    // Enleve les entrees retirees des seaux quand elles en sont la moitie
+    void compacter() {
+        if (nbRetires * 2 < seaux[0].size() * NB_BANDES) return;
+        for (size_t b = 0; b < NB_BANDES; b++) {
+            size_t j = 0;
+            for (size_t i = 0; i < seaux[b].size(); i++) {
+                if (!retires[b][i]) seaux[b][j++] = seaux[b][i];
+            }
+            seaux[b].resize(j);
+            retires[b].assign(j, false);
+        }
+        nbRetires = 0;
+    }
+
+    static constexpr uint64_t melanger(uint64_t x) {
+        x ^= x >> 33;
+        x *= 0xFF51AFD7ED558CCDULL;
+        x ^= x >> 33;
+        x *= 0xC4CEB9FE1A85EC53ULL;
+        x ^= x >> 33;
+        return x;
+    }
+
+    // Fonction i: (a_i * h + b_i) >> 32, a_i impair (multiplication-decalage)
+    struct Coefficients {
+        array<uint64_t, NB_HASH> a{}, b{};
+        constexpr Coefficients() {
+            for (size_t i = 0; i < NB_HASH; i++) {
+                a[i] = melanger(2 * i + 1) | 1;
+                b[i] = melanger(2 * i + 2);
+            }
+        }
+    };
+
+public:
+    // Trigrammes (3 octets empaquetes), tries et sans repetition
+    static void trigrammes(string_view texte, vector<uint32_t>& sortie) {
+        sortie.clear();
+        auto octet = [&texte](size_t i) { return static_cast<uint32_t>(static_cast<unsigned char>(texte[i])); };
+        if (texte.size() < 3) {
+            uint32_t t = 0;
+            for (size_t i = 0; i < texte.size(); i++) t = (t << 8) | octet(i);
+            if (!texte.empty()) sortie.push_back(t);
+            return;
+        }
+        for (size_t i = 0; i + 3 <= texte.size(); i++) {
+            sortie.push_back((octet(i) << 16) | (octet(i + 1) << 8) | octet(i + 2));
+        }
+        sort(sortie.begin(), sortie.end());
+        sortie.erase(unique(sortie.begin(), sortie.end()), sortie.end());
+    }
+
+    // Minimums des NB_HASH fonctions sur les trigrammes, puis chaque bande
+    // est resumee par un hachage de ses minimums. signature (NB_HASH octets,
+    // optionnelle) recoit l'octet de poids faible de chaque minimum.
+    static Cles cles(const vector<uint32_t>& tri, uint8_t* signature = nullptr) {
+        static constexpr Coefficients coef{};
+        array<uint32_t, NB_HASH> mins;
+        mins.fill(numeric_limits<uint32_t>::max());
+        for (uint32_t t : tri) {
+            uint64_t h = melanger(t + 0x9E3779B97F4A7C15ULL);
+            for (size_t i = 0; i < NB_HASH; i++) {
+                uint32_t v = static_cast<uint32_t>((coef.a[i] * h + coef.b[i]) >> 32);
+                mins[i] = min(mins[i], v);
+            }
+        }
+        if (signature) {
+            for (size_t i = 0; i < NB_HASH; i++) signature[i] = static_cast<uint8_t>(mins[i]);
+        }
+        Cles c;
+        for (size_t b = 0; b < NB_BANDES; b++) {
+            uint64_t h = b;
+            for (size_t l = 0; l < LIGNES_PAR_BANDE; l++) h = melanger(h ^ mins[b * LIGNES_PAR_BANDE + l]);
+            c[b] = static_cast<uint32_t>(h);
+        }
+        return c;
+    }
+
+    // Similarite estimee sur deux signatures d'octets: un octet egal a 1/256
+    // de chances de l'etre par hasard
+    static double similariteEstimee(const uint8_t* a, const uint8_t* b) {
+        size_t egaux = 0;
+        for (size_t i = 0; i < NB_HASH; i++) egaux += a[i] == b[i];
+        return (static_cast<double>(egaux) / NB_HASH - 1.0 / 256) / (1.0 - 1.0 / 256);
+    }
+
+    static double jaccard(const vector<uint32_t>& a, const vector<uint32_t>& b) {
+        if (a.empty() && b.empty()) return 1.0;
+        size_t communs = 0, i = 0, j = 0;
+        while (i < a.size() && j < b.size()) {
+            if (a[i] < b[j]) i++;
+            else if (b[j] < a[i]) j++;
+            else { communs++; i++; j++; }
+        }
+        return static_cast<double>(communs) / (a.size() + b.size() - communs);
+    }
+
+    // Remplace l'index par des seaux deja remplis (une entree par media et par bande)
+    void construire(Bandes&& parBande) {
+        seaux = move(parBande);
+        for (size_t b = 0; b < NB_BANDES; b++) {
+            if (!is_sorted(seaux[b].begin(), seaux[b].end())) sort(seaux[b].begin(), seaux[b].end());
+            retires[b].assign(seaux[b].size(), false);
+        }
+        nbRetires = 0;
+        for (auto& a : ajouts) a.clear();
+    }
+
+    void ajouter(int id, const Cles& c) {
+        for (size_t b = 0; b < NB_BANDES; b++) ajouts[b].emplace(c[b], id);
+    }
+
+    // c: cles avec lesquelles le media a ete indexe (celles de son texte
+    // actuel, recalculees par l'appelant avant de le supprimer ou remplacer)
+    void retirer(int id, const Cles& c) {
+        for (size_t b = 0; b < NB_BANDES; b++) {
+            auto it = lower_bound(seaux[b].begin(), seaux[b].end(), Entree{c[b], id});
+            for (; it != seaux[b].end() && it->cle == c[b] && it->id == id; ++it) {
+                auto i = static_cast<size_t>(it - seaux[b].begin());
+                if (retires[b][i]) continue;
+                retires[b][i] = true;
+                nbRetires++;
+                break;
+            }
+            if (it != seaux[b].end() && it->cle == c[b] && it->id == id) continue;
+            auto [debut, fin] = ajouts[b].equal_range(c[b]);
+            for (auto e = debut; e != fin; ++e) {
+                if (e->second == id) {
+                    ajouts[b].erase(e);
+                    break;
+                }
+            }
+        }
+        compacter();
+    }
+
+    // Ids partageant au moins un seau
+    vector<int> candidats(const Cles& c) const {
+        vector<int> ids;
+        for (size_t b = 0; b < NB_BANDES; b++) {
+            auto it = lower_bound(seaux[b].begin(), seaux[b].end(), Entree{c[b], numeric_limits<int>::min()});
+            for (; it != seaux[b].end() && it->cle == c[b]; ++it) {
+                if (!retires[b][static_cast<size_t>(it - seaux[b].begin())]) ids.push_back(it->id);
+            }
+            auto [debut, fin] = ajouts[b].equal_range(c[b]);
+            for (auto e = debut; e != fin; ++e) ids.push_back(e->second);
+        }
+        sort(ids.begin(), ids.end());
+        ids.erase(unique(ids.begin(), ids.end()), ids.end());
+        return ids;
+    }
+};
+
+// Regroupe les elements 0..n-1 relies par des paires (union-find)
+class Regroupement {
+private:
+    vector<uint32_t> parent;
+
+public:
+    explicit Regroupement(size_t n) : parent(n) {
+        for (size_t i = 0; i < n; i++) parent[i] = static_cast<uint32_t>(i);
+    }
+
+    uint32_t racine(uint32_t x) {
+        while (parent[x] != x) {
+            parent[x] = parent[parent[x]];   // compression par moitie
+            x = parent[x];
+        }
+        return x;
+    }
+
+    void unir(uint32_t a, uint32_t b) {
+        a = racine(a);
+        b = racine(b);
+        if (a != b) parent[max(a, b)] = min(a, b);
+    }
+};
+
+// ==========================================
+// ECHANGE JSON LINES / CSV (FRONT-END WEB)
+// ==========================================
+// Memes noms de champs que types.ts (MediaItem, User). JSON Lines: un objet
+// par ligne. CSV: RFC 4180 avec en-tete; colonnes dans n'importe quel ordre,
+// colonnes et cles inconnues ignorees. Les fichiers passent par blocs de
+// TAILLE_BLOC: la memoire utilisee ne depend pas de leur taille.
+enum class FormatEchange { JsonLignes, Csv };
+
+// .csv -> CSV, toute autre extension -> JSON Lines
+inline FormatEchange formatDepuisChemin(string_view chemin) {
+    string_view ext = chemin.substr(chemin.size() < 4 ? 0 : chemin.size() - 4);
+    return ext == ".csv" || ext == ".CSV" ? FormatEchange::Csv : FormatEchange::JsonLignes;
+}
+
+// Premier octet de [p, fin) egal a a, b, c ou d (avec CONTROLES: ou < 0x20),
+// fin si aucun. Avec SSE2, 16 octets sont compares par tour.
+template <bool CONTROLES = false>
+inline const char* chercherOctets(const char* p, const char* fin, char a, char b, char c, char d) {
+#ifdef __SSE2__
+    const __m128i va = _mm_set1_epi8(a), vb = _mm_set1_epi8(b);
+    const __m128i vc = _mm_set1_epi8(c), vd = _mm_set1_epi8(d);
+    const __m128i limite = _mm_set1_epi8(0x1F);
+    for (; fin - p >= 16; p += 16) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        __m128i m = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(x, va), _mm_cmpeq_epi8(x, vb)),
+                                 _mm_or_si128(_mm_cmpeq_epi8(x, vc), _mm_cmpeq_epi8(x, vd)));
+        if constexpr (CONTROLES) m = _mm_or_si128(m, _mm_cmpeq_epi8(_mm_max_epu8(x, limite), limite));
+        int bits = _mm_movemask_epi8(m);
+        if (bits != 0) return p + __builtin_ctz(static_cast<unsigned>(bits));
+    }
+#endif
+    for (; p < fin; p++) {
+        char o = *p;
+        if (o == a || o == b || o == c || o == d) return p;
+        if (CONTROLES && static_cast<unsigned char>(o) < 0x20) return p;
+    }
+    return fin;
+}
+
+// Nombre occupant tout le texte (pas de reste ignore comme lireEntier)
+template <class N>
+bool lireNombreExact(string_view texte, N& valeur) {
+    auto res = from_chars(texte.data(), texte.data() + texte.size(), valeur);
+    return res.ec == errc() && res.ptr == texte.data() + texte.size() && !texte.empty();
+}
+
+enum class NatureChamp : uint8_t { Texte, Entier, Reel, Booleen };
+
+struct ChampEchange {
+    const char* nom;
+    NatureChamp nature;
+};
+
+// Cles d'un MediaItem: celles de BaseMedia, puis les CHAMPS_ECHANGE des classes
+constexpr ChampEchange COLONNES_MEDIA[] = {
+    {"id", NatureChamp::Entier},         {"titre", NatureChamp::Texte},
+    {"dispo", NatureChamp::Booleen},     {"type", NatureChamp::Texte},
+    {"auteur", NatureChamp::Texte},      {"nPage", NatureChamp::Entier},
+    {"duree", NatureChamp::Entier},      {"qualite", NatureChamp::Texte},
+    {"publicateur", NatureChamp::Texte}, {"tailleMo", NatureChamp::Reel},
+    {"format", NatureChamp::Texte},
+};
+constexpr size_t NB_COLONNES_MEDIA = size(COLONNES_MEDIA);
+constexpr size_t COL_ID = 0, COL_TITRE = 1, COL_DISPO = 2, COL_TYPE = 3;
+
+constexpr ChampEchange COLONNES_UTILISATEUR[] = {
+    {"username", NatureChamp::Texte}, {"passwordHash", NatureChamp::Texte}, {"role", NatureChamp::Texte},
+};
+constexpr size_t NB_COLONNES_UTILISATEUR = size(COLONNES_UTILISATEUR);
+constexpr size_t COL_USERNAME = 0, COL_HASH = 1, COL_ROLE = 2;
+
+constexpr size_t COLONNES_MAX = 32;   // colonnes presentes: masque de 32 bits
+static_assert(NB_COLONNES_MEDIA <= COLONNES_MAX, "trop de colonnes");
+
+// Indice de la colonne nommee, ou n si elle est inconnue
+constexpr size_t colonneDe(const ChampEchange* colonnes, size_t n, string_view nom) {
+    for (size_t i = 0; i < n; i++) {
+        if (nom == colonnes[i].nom) return i;
+    }
+    return n;
+}
+
+// Colonne de chaque champ propre d'un type, dans l'ordre de la ligne
+struct ColonnesType {
+    size_t nombre;
+    array<size_t, 4> colonnes;
+};
+
+constexpr array<ColonnesType, NB_TYPES_MEDIA> colonnesParType() {
+    array<ColonnesType, NB_TYPES_MEDIA> table{};
+    for (size_t t = 0; t < NB_TYPES_MEDIA; t++) {
+        const OperationsMedia& ops = REGISTRE_MEDIA[t];
+        table[t].nombre = ops.nbChamps - 4;
+        for (size_t i = 0; i < table[t].nombre; i++) {
+            table[t].colonnes[i] = colonneDe(COLONNES_MEDIA, NB_COLONNES_MEDIA, ops.champsEchange[i]);
+        }
+    }
+    return table;
+}
+constexpr array<ColonnesType, NB_TYPES_MEDIA> COLONNES_PAR_TYPE = colonnesParType();
+
+constexpr bool colonnesConnues() {
+    for (const auto& t : COLONNES_PAR_TYPE) {
+        for (size_t i = 0; i < t.nombre; i++) {
+            if (t.colonnes[i] >= NB_COLONNES_MEDIA) return false;
+        }
+    }
+    return true;
+}
+static_assert(colonnesConnues(), "chaque CHAMPS_ECHANGE doit figurer dans COLONNES_MEDIA");
+
+// Ecrit dans chemin.tmp, renomme sur chemin par terminer(): un export
+// interrompu ne remplace jamais le fichier precedent.
+class EcrivainEchange {
+private:
+    static constexpr size_t TAILLE_BLOC = 1 << 20;
+    string chemin;
+    ofstream fichier;
+    FormatEchange format;
+    const ChampEchange* colonnes;
+    size_t nbColonnes;
+    TamponEcriture t;
+    size_t nombre = 0;
+    size_t octets = 0;
+
+    void vider() {
+        fichier.write(t.contenu().data(), static_cast<streamsize>(t.taille()));
+        octets += t.taille();
+        t.vider();
+    }
+
+    void texteJson(string_view s) {
+        static const char HEX[] = "0123456789abcdef";
+        const char* p = s.data();
+        const char* fin = p + s.size();
+        t << '"';
+        while (true) {
+            const char* q = chercherOctets<true>(p, fin, '"', '\\', '"', '\\');
+            t << string_view(p, static_cast<size_t>(q - p));
+            if (q == fin) break;
+            switch (*q) {
+                case '"':  t << "\\\""; break;
+                case '\\': t << "\\\\"; break;
+                case '\n': t << "\\n"; break;
+                case '\r': t << "\\r"; break;
+                case '\t': t << "\\t"; break;
+                default: {
+                    char u[] = {'\\', 'u', '0', '0', HEX[(*q >> 4) & 0xF], HEX[*q & 0xF]};
+                    t << string_view(u, sizeof(u));
+                }
+            }
+            p = q + 1;
+        }
+        t << '"';
+    }
+
+    // Entre guillemets seulement si necessaire; " est double
+    void texteCsv(string_view s) {
+        const char* p = s.data();
+        const char* fin = p + s.size();
+        if (chercherOctets(p, fin, ',', '"', '\n', '\r') == fin) {
+            t << s;
+            return;
+        }
+        t << '"';
+        while (true) {
+            const char* q = chercherOctets(p, fin, '"', '"', '"', '"');
+            t << string_view(p, static_cast<size_t>(q - p));
+            if (q == fin) break;
+            t << "\"\"";
+            p = q + 1;
+        }
+        t << '"';
+    }
+
+    // v est au format du fichier ';': les nombres sont relus puis reformates
+    void valeur(NatureChamp nature, string_view v) {
+        bool json = format == FormatEchange::JsonLignes;
+        switch (nature) {
+            case NatureChamp::Entier:  t << lireEntier(v); break;
+            case NatureChamp::Reel: {
+                double d = lireReel(v);
+                t << (isfinite(d) ? d : 0.0);
+                break;
+            }
+            case NatureChamp::Booleen: t << (v == "1" ? "true" : "false"); break;
+            default:
+                if (json) texteJson(v);
+                else texteCsv(v);
+        }
+    }
+
+public:
+    EcrivainEchange(string cheminFinal, FormatEchange format, const ChampEchange* colonnes, size_t nbColonnes)
+        : chemin(move(cheminFinal)), fichier(chemin + ".tmp", ios::binary | ios::trunc),
+          format(format), colonnes(colonnes), nbColonnes(nbColonnes) {
+        t.reserver(TAILLE_BLOC + TAILLE_BLOC / 4);
+        if (format == FormatEchange::Csv) {
+            for (size_t i = 0; i < nbColonnes; i++) t << (i ? "," : "") << colonnes[i].nom;
+            t << "\r\n";
+        }
+    }
+
+    bool ouvert() const { return static_cast<bool>(fichier); }
+    size_t nombreEcrits() const { return nombre; }
+    size_t octetsEcrits() const { return octets + t.taille(); }
+
+    // valeurs[i]: colonne i au format du fichier ';', absente si le bit i de
+    // presents est nul (cle omise en JSON, cellule vide en CSV)
+    void ecrire(const string_view* valeurs, uint32_t presents) {
+        bool json = format == FormatEchange::JsonLignes;
+        bool premier = true;
+        if (json) t << '{';
+        for (size_t i = 0; i < nbColonnes; i++) {
+            bool present = (presents >> i) & 1;
+            if (json) {
+                if (!present) continue;
+                t << (premier ? "\"" : ",\"") << colonnes[i].nom << "\":";
+                premier = false;
+            } else if (i > 0) {
+                t << ',';
+            }
+            if (present) valeur(colonnes[i].nature, valeurs[i]);
+        }
+        t << (json ? "}\n" : "\r\n");
+        nombre++;
+        if (t.taille() >= TAILLE_BLOC) vider();
+    }
+
+    // Faux si une ecriture a echoue; le fichier precedent est alors intact
+    bool terminer() {
+        vider();
+        fichier.close();
+        error_code ec;
+        if (!fichier) {
+            fs::remove(chemin + ".tmp", ec);
+            return false;
+        }
+        fs::rename(chemin + ".tmp", chemin, ec);
+        return !ec;
+    }
+};
+
+// Lit un fichier d'echange par blocs. Apres suivant(), valeur(i) pointe dans
+// le bloc, ou dans un tampon propre a la colonne si le texte a du etre
+// decode (echappements JSON, "" du CSV): valable jusqu'au suivant().
+class LecteurEchange {
+private:
+    static constexpr size_t TAILLE_BLOC = 1 << 20;
+    ifstream fichier;
+    FormatEchange format;
+    const ChampEchange* colonnes;
+    size_t nbColonnes;
+    string bloc;
+    size_t debut = 0, fin = 0;          // donnees non consommees: bloc[debut, fin)
+    bool finFichier = false;
+    size_t octets = 0;
+
+    vector<string_view> valeurs;
+    vector<string> decodes;             // un par colonne connue (JSON)
+    string cleDecodee, autre;
+    uint32_t presents = 0;
+    size_t numero = 0;                  // enregistrements lus, valides ou non
+    string raison;                      // vide si l'enregistrement est valide
+
+    vector<string_view> cellules;       // CSV: cellules de la ligne courante
+    deque<string> cellulesDecodees;     // adresses stables quand la ligne s'allonge
+    vector<size_t> colonnesCsv;         // colonne connue de chaque colonne du CSV
+
+    // Garde bloc[debut, fin) en tete puis complete depuis le fichier; le bloc
+    // double si un seul enregistrement le remplit. Faux si rien n'a ete lu.
+    bool remplir() {
+        if (finFichier) return false;
+        size_t reste = fin - debut;
+        if (debut > 0 && reste > 0) memmove(&bloc[0], bloc.data() + debut, reste);
+        debut = 0;
+        fin = reste;
+        if (fin == bloc.size()) bloc.resize(max(TAILLE_BLOC, bloc.size() * 2));
+        fichier.read(&bloc[fin], static_cast<streamsize>(bloc.size() - fin));
+        size_t lus = static_cast<size_t>(fichier.gcount());
+        fin += lus;
+        octets += lus;
+        if (!fichier) finFichier = true;
+        return lus > 0;
+    }
+
+    bool echec(string message) {
+        raison = move(message);
+        return false;
+    }
+
+    static bool lireHex4(const char* p, const char* f, uint32_t& v) {
+        return f - p >= 4 && from_chars(p, p + 4, v, 16).ptr == p + 4;
+    }
+
+    static void ajouterUtf8(string& s, uint32_t cp) {
+        if (cp < 0x80) {
+            s += static_cast<char>(cp);
+        } else if (cp < 0x800) {
+            s += static_cast<char>(0xC0 | (cp >> 6));
+            s += static_cast<char>(0x80 | (cp & 0x3F));
+        } else if (cp < 0x10000) {
+            s += static_cast<char>(0xE0 | (cp >> 12));
+            s += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+            s += static_cast<char>(0x80 | (cp & 0x3F));
+        } else {
+            s += static_cast<char>(0xF0 | (cp >> 18));
+            s += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+            s += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+            s += static_cast<char>(0x80 | (cp & 0x3F));
+        }
+    }
+
+    // p sur le guillemet ouvrant, puis juste apres le guillemet fermant.
+    // Sans echappement, sortie pointe dans la ligne (aucune copie).
+    static bool chaineJson(const char*& p, const char* f, string_view& sortie, string& tampon) {
+        p++;
+        const char* q = chercherOctets(p, f, '"', '\\', '"', '\\');
+        if (q < f && *q == '"') {
+            sortie = string_view(p, static_cast<size_t>(q - p));
+            p = q + 1;
+            return true;
+        }
+        tampon.clear();
+        while (q < f && *q == '\\') {
+            tampon.append(p, q);
+            if (++q == f) return false;
+            switch (*q) {
+                case '"': case '\\': case '/': tampon += *q; break;
+                case 'b': tampon += '\b'; break;
+                case 'f': tampon += '\f'; break;
+                case 'n': tampon += '\n'; break;
+                case 'r': tampon += '\r'; break;
+                case 't': tampon += '\t'; break;
+                case 'u': {
+                    uint32_t cp = 0, bas = 0;
+                    if (!lireHex4(q + 1, f, cp)) return false;
+                    q += 4;
+                    // Paire de substitution UTF-16
+                    if (cp >= 0xD800 && cp < 0xDC00 && f - q > 2 && q[1] == '\\' && q[2] == 'u' &&
+                        lireHex4(q + 3, f, bas) && bas >= 0xDC00 && bas < 0xE000) {
+                        cp = 0x10000 + ((cp - 0xD800) << 10) + (bas - 0xDC00);
+                        q += 6;
+                    }
+                    ajouterUtf8(tampon, cp);
+                    break;
+                }
+                default: return false;
+            }
+            p = q + 1;
+            q = chercherOctets(p, f, '"', '\\', '"', '\\');
+        }
+        if (q == f) return false;
+        tampon.append(p, q);
+        sortie = tampon;
+        p = q + 1;
+        return true;
+    }
+
+    // Objet plat: textes, nombres, true/false; null vaut absent
+    bool analyserJson(string_view ligne) {
+        const char* p = ligne.data();
+        const char* f = p + ligne.size();
+        auto blancs = [&]() {
+            while (p < f && (*p == ' ' || *p == '\t' || *p == '\r')) p++;
+        };
+        blancs();
+        if (p == f || *p != '{') return echec("objet JSON attendu");
+        p++;
+        blancs();
+        if (p < f && *p == '}') {
+            p++;
+        } else {
+            while (true) {
+                blancs();
+                string_view cle, v;
+                if (p == f || *p != '"' || !chaineJson(p, f, cle, cleDecodee)) return echec("cle invalide");
+                blancs();
+                if (p == f || *p != ':') return echec("':' attendu apres " + string(cle));
+                p++;
+                blancs();
+                size_t col = colonneDe(colonnes, nbColonnes, cle);
+                bool present = true;
+                if (p < f && *p == '"') {
+                    if (!chaineJson(p, f, v, col < nbColonnes ? decodes[col] : autre)) {
+                        return echec("texte invalide pour " + string(cle));
+                    }
+                } else {
+                    const char* q = chercherOctets(p, f, ',', '}', ' ', '\t');
+                    v = string_view(p, static_cast<size_t>(q - p));
+                    p = q;
+                    if (v.empty() || v[0] == '{' || v[0] == '[') return echec("valeur non prise en charge pour " + string(cle));
+                    present = v != "null";
+                }
+                if (col < nbColonnes && present) {
+                    valeurs[col] = v;
+                    presents |= 1u << col;
+                }
+                blancs();
+                if (p < f && *p == ',') {
+                    p++;
+                    continue;
+                }
+                if (p < f && *p == '}') {
+                    p++;
+                    break;
+                }
+                return echec("',' ou '}' attendu");
+            }
+        }
+        blancs();
+        return p == f || echec("texte apres l'objet");
+    }
+
+    bool suivantJson() {
+        while (true) {
+            const char* p = bloc.data() + debut;
+            const char* f = bloc.data() + fin;
+            const char* nl = static_cast<const char*>(memchr(p, '\n', static_cast<size_t>(f - p)));
+            if (!nl && !finFichier) {
+                remplir();   // deplace le bloc: p et f sont recalcules
+                continue;
+            }
+            if (p == f) return false;
+            const char* finLigne = nl ? nl : f;
+            debut = static_cast<size_t>(finLigne - bloc.data()) + (nl ? 1 : 0);
+            string_view ligne(p, static_cast<size_t>(finLigne - p));
+            if (ligne.find_first_not_of(" \t\r") == string_view::npos) continue;
+            numero++;
+            presents = 0;
+            raison.clear();
+            analyserJson(ligne);
+            return true;
+        }
+    }
+
+    // Decoupe dans cellules l'enregistrement CSV qui commence a bloc[debut].
+    // Faux s'il est coupe par la fin du bloc et que le fichier continue.
+    bool decouperCsv() {
+        const char* p = bloc.data() + debut;
+        const char* f = bloc.data() + fin;
+        cellules.clear();
+        raison.clear();
+        while (true) {
+            size_t j = cellules.size();
+            if (j == cellulesDecodees.size()) cellulesDecodees.emplace_back();
+            string_view v;
+            if (p < f && *p == '"') {
+                string& tampon = cellulesDecodees[j];
+                const char* morceau = ++p;
+                bool copie = false;
+                while (true) {
+                    const char* q = chercherOctets(p, f, '"', '"', '"', '"');
+                    if (q == f || (q + 1 == f && !finFichier)) {
+                        if (!finFichier) return false;
+                        raison = "guillemet non ferme";
+                        v = string_view(morceau, static_cast<size_t>(f - morceau));
+                        p = f;
+                        break;
+                    }
+                    if (q + 1 < f && q[1] == '"') {   // "" dans un champ entre guillemets
+                        if (!copie) tampon.clear();
+                        tampon.append(morceau, q + 1);
+                        p = morceau = q + 2;
+                        copie = true;
+                        continue;
+                    }
+                    if (copie) {
+                        tampon.append(morceau, q);
+                        v = tampon;
+                    } else {
+                        v = string_view(morceau, static_cast<size_t>(q - morceau));
+                    }
+                    p = q + 1;
+                    if (p < f && *p != ',' && *p != '\n' && *p != '\r') {
+                        raison = "texte apres un champ entre guillemets";
+                        p = chercherOctets(p, f, ',', '\n', '\r', ',');
+                    }
+                    break;
+                }
+            } else {
+                const char* q = chercherOctets(p, f, ',', '\n', '\r', ',');
+                v = string_view(p, static_cast<size_t>(q - p));
+                p = q;
+            }
+            cellules.push_back(v);
+
+            if (p == f) {
+                if (!finFichier) return false;
+                debut = fin;
+                return true;
+            }
+            if (*p == ',') {
+                p++;
+                continue;
+            }
+            if (*p == '\r') {   // \r\n, ou \r seul
+                if (p + 1 == f && !finFichier) return false;
+                p++;
+                if (p < f && *p == '\n') p++;
+            } else {
+                p++;
+            }
+            debut = static_cast<size_t>(p - bloc.data());
+            return true;
+        }
+    }
+
+    bool ligneCsv() {
+        while (true) {
+            if (debut == fin && !remplir()) return false;
+            if (!decouperCsv()) {
+                remplir();
+                continue;
+            }
+            if (cellules.size() == 1 && cellules[0].empty()) continue;   // ligne vide
+            return true;
+        }
+    }
+
+    bool suivantCsv() {
+        if (!ligneCsv()) return false;
+        numero++;
+        presents = 0;
+        for (size_t j = 0; j < cellules.size() && j < colonnesCsv.size(); j++) {
+            size_t col = colonnesCsv[j];
+            if (col < nbColonnes && !cellules[j].empty()) {
+                valeurs[col] = cellules[j];
+                presents |= 1u << col;
+            }
+        }
+        return true;
+    }
+
+public:
+    LecteurEchange(const string& chemin, FormatEchange format, const ChampEchange* colonnes, size_t nbColonnes)
+        : fichier(chemin, ios::binary), format(format), colonnes(colonnes), nbColonnes(nbColonnes),
+          valeurs(nbColonnes), decodes(nbColonnes) {
+        if (!fichier) return;
+        bloc.resize(TAILLE_BLOC);
+        remplir();
+        if (fin >= 3 && memcmp(bloc.data(), "\xEF\xBB\xBF", 3) == 0) debut = 3;   // BOM UTF-8
+        if (format == FormatEchange::Csv && ligneCsv()) {
+            for (string_view nom : cellules) colonnesCsv.push_back(colonneDe(colonnes, nbColonnes, nom));
+        }
+    }
+
+    bool ouvert() const { return fichier.is_open(); }
+
+    // Enregistrement suivant; faux a la fin du fichier. Un enregistrement mal
+    // forme est rendu quand meme, avec valide() faux et sa raison().
+    bool suivant() {
+        return format == FormatEchange::Csv ? suivantCsv() : suivantJson();
+    }
+
+    bool valide() const { return raison.empty(); }
+    const string& getRaison() const { return raison; }
+    size_t getNumero() const { return numero; }
+    size_t octetsLus() const { return octets; }
+
+    // En CSV, une colonne absente de l'en-tete
+    bool colonneManquante(size_t col) const {
+        return format == FormatEchange::Csv && find(colonnesCsv.begin(), colonnesCsv.end(), col) == colonnesCsv.end();
+    }
+
+    bool present(size_t col) const { return (presents >> col) & 1; }
+    string_view valeur(size_t col) const { return present(col) ? valeurs[col] : string_view(); }
+};
+
+// Valeurs des colonnes d'une ligne du fichier ';'. Faux si la ligne est invalide.
+inline bool valeursMedia(string_view ligne, vector<string_view>& champs, string_view* valeurs, uint32_t& presents) {
+    decouperChamps(ligne, champs);
+    TypeMedia type;
+    if (champs.size() < 4 || !typeDepuisNom(champs[0], type)) return false;
+    const ColonnesType& propres = COLONNES_PAR_TYPE[static_cast<size_t>(type)];
+    if (champs.size() < 4 + propres.nombre) return false;
+    valeurs[COL_ID] = champs[1];
+    valeurs[COL_TITRE] = champs[2];
+    valeurs[COL_DISPO] = champs[3];
+    valeurs[COL_TYPE] = champs[0];
+    presents = (1u << COL_ID) | (1u << COL_TITRE) | (1u << COL_DISPO) | (1u << COL_TYPE);
+    size_t d = propres.nombre == 4 && champs.size() >= 10 ? 6 : 4;   // anciennes sauvegardes, cf. lireChamps
+    for (size_t i = 0; i < propres.nombre; i++) {
+        valeurs[propres.colonnes[i]] = champs[d + i];
+        presents |= 1u << propres.colonnes[i];
+    }
+    return true;
+}
+
+// Texte recopiable dans une ligne du fichier ';'
+inline bool texteSansSeparateur(string_view texte) {
+    return texte.find_first_of(";\r\n") == string_view::npos;
+}
+
+// Ligne du fichier ';' depuis les valeurs par colonne (une colonne absente
+// vaut vide). Faux (et raison) si le type ou l'id manque, si un nombre est
+// invalide ou si un texte contient ';' ou un saut de ligne, que le fichier
+// ne sait pas representer.
+bool ligneMediaDepuisValeurs(const string_view* valeurs, uint32_t presents, TamponEcriture& ligne, int& id,
+                             string& raison) {
+    TypeMedia type;
+    if (!typeDepuisNom(valeurs[COL_TYPE], type)) {
+        raison = "type absent ou inconnu";
+        return false;
+    }
+    if (!lireNombreExact(valeurs[COL_ID], id)) {
+        raison = "id absent ou invalide";
+        return false;
+    }
+    bool dispo = true;   // comme un ajout depuis le front-end
+    if ((presents >> COL_DISPO) & 1) {
+        string_view v = valeurs[COL_DISPO];
+        if (v == "false" || v == "0") dispo = false;
+        else if (v != "true" && v != "1") {
+            raison = "dispo invalide";
+            return false;
+        }
+    }
+    if (!texteSansSeparateur(valeurs[COL_TITRE])) {
+        raison = "titre avec ';' ou saut de ligne";
+        return false;
+    }
+
+    ligne.vider();
+    ligne << operations(type).nom << ';' << id << ';' << valeurs[COL_TITRE] << ';' << (dispo ? '1' : '0');
+    const ColonnesType& propres = COLONNES_PAR_TYPE[static_cast<size_t>(type)];
+    for (size_t i = 0; i < propres.nombre; i++) {
+        const ChampEchange& champ = COLONNES_MEDIA[propres.colonnes[i]];
+        string_view v = valeurs[propres.colonnes[i]];
+        bool ok = true;
+        ligne << ';';
+        if (champ.nature == NatureChamp::Entier) {
+            int n = 0;
+            ok = v.empty() || lireNombreExact(v, n);
+            ligne << n;
+        } else if (champ.nature == NatureChamp::Reel) {
+            double d = 0.0;
+            ok = v.empty() || (lireNombreExact(v, d) && isfinite(d));
+            ligne << d;
+        } else {
+            ok = texteSansSeparateur(v);
+            ligne << v;
+        }
+        if (!ok) {
+            raison = string(champ.nom) + " invalide";
+            return false;
+        }
+    }
+    return true;
+}
+
+constexpr size_t REJETS_AFFICHES = 5;   // les suivants sont seulement comptes
+
+inline void signalerRejet(size_t& rejetes, size_t numero, const string& raison) {
+    if (++rejetes <= REJETS_AFFICHES) cout << ">> Enregistrement " << numero << " ignore: " << raison << endl;
+}
+
+// Les empreintes de mot de passe sont recopiees telles quelles. Le front-end
+// hache autrement: un compte venu du web change de mot de passe ici.
+bool exporterUtilisateurs(const GestionUtilisateurs& gestion, const string& chemin) {
+    EcrivainEchange sortie(chemin, formatDepuisChemin(chemin), COLONNES_UTILISATEUR, NB_COLONNES_UTILISATEUR);
+    if (!sortie.ouvert()) {
+        cout << ">> Erreur: Impossible de creer " << chemin << endl;
+        return false;
+    }
+    for (const auto& compte : gestion.getComptes()) {
+        string nom = compte.getUsername(), empreinte = compte.getPasswordHash();
+        string_view valeurs[] = {nom, empreinte, compte.getRole()};
+        sortie.ecrire(valeurs, (1u << NB_COLONNES_UTILISATEUR) - 1);
+    }
+    if (!sortie.terminer()) {
+        cout << ">> Erreur: Echec de l'ecriture de " << chemin << endl;
+        return false;
+    }
+    cout << ">> " << sortie.nombreEcrits() << " utilisateurs exportes vers " << chemin << endl;
+    return true;
+}
+
+// Ajoute les comptes absents; un nom deja pris n'est pas modifie
+size_t importerUtilisateurs(GestionUtilisateurs& gestion, const string& chemin) {
+    LecteurEchange entree(chemin, formatDepuisChemin(chemin), COLONNES_UTILISATEUR, NB_COLONNES_UTILISATEUR);
+    if (!entree.ouvert()) {
+        cout << ">> Erreur: Impossible d'ouvrir " << chemin << endl;
+        return 0;
+    }
+    size_t importes = 0, existants = 0, rejetes = 0;
+    while (entree.suivant()) {
+        string raison = entree.getRaison();
+        string_view nom = entree.valeur(COL_USERNAME), empreinte = entree.valeur(COL_HASH);
+        string_view role = entree.valeur(COL_ROLE);
+        if (!entree.valide()) {
+            // raison deja connue
+        } else if (nom.empty() || empreinte.empty()) {
+            raison = "username ou passwordHash absent";
+        } else if (role != "Client" && role != "Admin" && role != "SuperAdmin") {
+            raison = "role invalide";
+        } else if (!texteSansSeparateur(nom) || !texteSansSeparateur(empreinte)) {
+            raison = "';' ou saut de ligne dans le nom ou l'empreinte";
+        } else if (!gestion.importerCompte(string(nom), string(empreinte), string(role))) {
+            existants++;
+            continue;
+        } else {
+            importes++;
+            continue;
+        }
+        signalerRejet(rejetes, entree.getNumero(), raison);
+    }
+    if (importes > 0) gestion.sauvegarderUtilisateurs();
+    cout << ">> " << importes << " utilisateurs importes depuis " << chemin << ", " << existants
+         << " deja present(s), " << rejetes << " ignore(s)" << endl;
+    return importes;
+}
+
+// ==========================================
+// BIBLIOTHEQUE
+// ==========================================
+// Resultat de recherche classee (score plus eleve = plus pertinent)
+struct ResultatRecherche {
+    double score;
+    size_t position;      // indice de la fiche dans le catalogue
+    int id;
+    const Media* media;   // renseigne pour les resultats renvoyes
+
+    bool meilleurQue(const ResultatRecherche& autre) const {
+        if (score != autre.score) return score > autre.score;
+        return id < autre.id;   // departage stable
+    }
+};
+
+// Pertinence d'une correspondance trouvee a la position pos de la cle du titre
+double scorerCorrespondance(string_view cle, bool dispo, const string& requete, size_t pos) {
+    auto debutDeMot = [&cle](size_t p) {
+        return p == 0 || !isalnum(static_cast<unsigned char>(cle[p - 1]));
+    };
+
+    double score = 100.0;
+    if (pos == 0) score += 60.0;                       // le titre commence par la requete
+    bool prefixeMot = debutDeMot(pos);
+    for (size_t p = pos; !prefixeMot && p != string::npos; p = cle.find(requete, p + 1)) {
+        prefixeMot = debutDeMot(p);                    // une autre occurrence en debut de mot ?
+    }
+    if (prefixeMot) score += 40.0;
+    score -= static_cast<double>(min<size_t>(pos, 40));   // plus la correspondance est tot, mieux c'est
+    if (!cle.empty()) score += 30.0 * requete.size() / cle.size();   // titres courts favorises
+    if (dispo) score += 10.0;
+    return score;
+}
+
+// Entree du catalogue. Tant que media est nul, seuls id, type et dispo sont
+// decodes: le reste est lu dans la ligne brute du fichier au premier acces.
+struct Fiche {
+    int id;
+    TypeMedia type;
+    bool dispo;          // fait foi tant que media est nul
+    bool modifiee;       // changee en memoire depuis le chargement ou la derniere sauvegarde
+    string_view ligne;   // ligne d'origine dans le fichier charge (vide si ajout)
+    Media* media;
+    uint64_t empreinte;  // empreinte de la ligne au dernier chargement/sauvegarde (0: jamais ecrite)
+
+    bool estDispo() const { return media ? media->isDispo() : dispo; }
+};
+
+// Table id -> indice du catalogue, en adressage ouvert (pas d'allocation par entree)
+class IndexIds {
+private:
+    static constexpr uint32_t VIDE = numeric_limits<uint32_t>::max();
+    struct Case {
+        int id;
+        uint32_t position;
+    };
+    vector<Case> cases;
+    size_t nombre = 0;
+
+    size_t depart(int id) const {
+        return (static_cast<uint32_t>(id) * 0x9E3779B1u) & (cases.size() - 1);
+    }
+
+    void agrandir() {
+        vector<Case> anciennes = move(cases);
+        cases.assign(max<size_t>(16, anciennes.size() * 2), Case{0, VIDE});
+        nombre = 0;
+        for (const auto& c : anciennes) {
+            if (c.position != VIDE) inserer(c.id, c.position);
+        }
+    }
+
+public:
+    // Garde la premiere position connue d'un id en double
+    void inserer(int id, size_t position) {
+        if ((nombre + 1) * 2 > cases.size()) agrandir();
+        for (size_t i = depart(id);; i = (i + 1) & (cases.size() - 1)) {
+            if (cases[i].position == VIDE) {
+                cases[i] = {id, static_cast<uint32_t>(position)};
+                nombre++;
+                return;
+            }
+            if (cases[i].id == id) return;
+        }
+    }
+
+    // Indice de l'id, ou SIZE_MAX s'il est absent
+    size_t trouver(int id) const {
+        if (cases.empty()) return SIZE_MAX;
+        for (size_t i = depart(id);; i = (i + 1) & (cases.size() - 1)) {
+            if (cases[i].position == VIDE) return SIZE_MAX;
+            if (cases[i].id == id) return cases[i].position;
+        }
+    }
+
+    // Nouvelle position d'un id present
+    void deplacer(int id, size_t position) {
+        if (cases.empty()) return;
+        for (size_t i = depart(id);; i = (i + 1) & (cases.size() - 1)) {
+            if (cases[i].position == VIDE) return;
+            if (cases[i].id == id) {
+                cases[i].position = static_cast<uint32_t>(position);
+                return;
+            }
+        }
+    }
+
+    // Retire l'id sans pierre tombale: les cases suivantes de la meme
+    // sequence remontent dans le trou si leur case de depart le permet
+    void retirer(int id) {
+        if (cases.empty()) return;
+        const size_t masque = cases.size() - 1;
+        size_t trou = depart(id);
+        for (;; trou = (trou + 1) & masque) {
+            if (cases[trou].position == VIDE) return;
+            if (cases[trou].id == id) break;
+        }
+        for (size_t j = (trou + 1) & masque; cases[j].position != VIDE; j = (j + 1) & masque) {
+            size_t d = depart(cases[j].id);
+            if (((j - d) & masque) >= ((j - trou) & masque)) {
+                cases[trou] = cases[j];
+                trou = j;
+            }
+        }
+        cases[trou].position = VIDE;
+        nombre--;
+    }
+
+    // Ids distincts indexes: moins que de fiches si le fichier a des ids en double
+    size_t taille() const { return nombre; }
+
+    void reconstruire(const vector<Fiche>& catalogue) {
+        size_t capacite = 16;   // puissance de deux: depart() masque avec capacite - 1
+        while (capacite < catalogue.size() * 2) capacite *= 2;
+        cases.assign(capacite, Case{0, VIDE});
+        nombre = 0;
+        for (size_t i = 0; i < catalogue.size(); i++) inserer(catalogue[i].id, i);
+    }
+};
+
+// Compteurs de afficherStatistiques, tenus a jour apres le premier calcul
+struct StatsCatalogue {
+    long long total = 0;
+    long long dispo = 0;
+    long long livres = 0;
+    long long duree = 0;
+};
+
+void afficherStatistiquesCatalogue(const StatsCatalogue& stats) {
+    cout << "\n--- STATISTIQUES ---" << endl;
+    cout << "Nombre total de medias : " << stats.total << endl;
+    cout << "Medias disponibles : " << stats.dispo << endl;
+    cout << "Duree totale (Audio/Video) : " << stats.duree << " min" << endl;
+    cout << "Nombre de livres (Papier/Ebook/AudioBook) : " << stats.livres << endl;
+    PoolChaines::global().afficherStatistiques();
+}
+
+void afficherPret(const Pret& p, string_view titre, Horodatage t, bool avecEmprunteur) {
+    cout << "ID:" << p.idMedia << " | " << titre;
+    if (avecEmprunteur) cout << " | " << p.emprunteur;
+    cout << " | Emprunte le " << formaterDate(p.debut)
+         << " | A rendre le " << formaterDate(p.echeance);
+    if (p.echeance <= t) cout << " | EN RETARD (" << (t - p.echeance) / SECONDES_PAR_JOUR << " j)";
+    cout << endl;
+}
+
+// titreDe(id) donne le titre affiche a cote de chaque id
+template <class TitreDe>
+void afficherClassementsPopularite(const AnalyseEmprunts& analyse, TitreDe&& titreDe) {
+    Horodatage t = maintenant();
+    auto debut = chrono::steady_clock::now();
+    auto semaine = analyse.plusEmpruntes(10, 7, t);
+    auto mois = analyse.plusEmpruntes(10, 30, t);
+    auto montantes = analyse.tendances(10, t);
+    auto us = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - debut).count();
+
+    auto afficher = [&titreDe](const char* titre, const vector<Popularite>& liste, uint64_t total) {
+        cout << "\n--- " << titre << " (" << total << " emprunts) ---" << endl;
+        for (const auto& p : liste) {
+            cout << "ID:" << p.id << " | " << titreDe(p.id) << " | ~" << p.emprunts << " emprunts";
+            if (p.tendance > 0) cout << " | x" << fixed << setprecision(1) << p.tendance << defaultfloat;
+            cout << endl;
+        }
+        if (liste.empty()) cout << "Aucun emprunt sur la periode." << endl;
+    };
+    afficher("LES PLUS EMPRUNTES CETTE SEMAINE", semaine, analyse.total(7, t));
+    afficher("LES PLUS EMPRUNTES CE MOIS", mois, analyse.total(30, t));
+    afficher("EN HAUSSE (semaine / 3 semaines precedentes)", montantes, analyse.total(7, t));
+    cout << "(" << us << " us)" << endl;
+}
+
+void afficherRapportDetaille(const AccumulateurRapport& rapport, size_t nbMedias, long long ms) {
+    auto pourcent = [](uint64_t partie, uint64_t total) {
+        return total ? 100.0 * partie / total : 0.0;
+    };
+    // Les n groupes les plus nombreux
+    auto afficherGroupes = [&](const char* titre, const unordered_map<string_view, TotauxGroupe>& groupes, size_t n) {
+        if (groupes.empty()) return;
+        vector<pair<string_view, TotauxGroupe>> tries(groupes.begin(), groupes.end());
+        size_t garde = min(n, tries.size());
+        partial_sort(tries.begin(), tries.begin() + garde, tries.end(), [](const auto& a, const auto& b) {
+            return a.second.nombre != b.second.nombre ? a.second.nombre > b.second.nombre : a.first < b.first;
+        });
+        cout << titre << " (" << groupes.size() << " au total) :" << endl;
+        for (size_t i = 0; i < garde; i++) {
+            cout << "  " << left << setw(24) << tries[i].first << right << setw(8) << tries[i].second.nombre
+                 << " | dispo " << setw(5) << pourcent(tries[i].second.dispo, tries[i].second.nombre) << "%" << endl;
+        }
+    };
+
+    cout << fixed << setprecision(1);
+    cout << "\n--- RAPPORT DETAILLE (" << nbMedias << " medias, "
+         << PoolFils::global().taille() << " fil(s), " << ms << " ms) ---" << endl;
+    cout << "Par type :" << endl;
+    for (const auto& ops : REGISTRE_MEDIA) {
+        const TotauxGroupe& g = rapport.parType[static_cast<size_t>(ops.type)];
+        if (g.nombre == 0) continue;
+        cout << "  " << left << setw(10) << ops.nom << right << setw(8) << g.nombre
+             << " | dispo " << setw(5) << pourcent(g.dispo, g.nombre) << "%";
+        if (ops.estLivre) cout << " | " << static_cast<double>(g.pages) / g.nombre << " p. en moyenne";
+        if (ops.aDuree) cout << " | " << g.duree << " min au total";
+        if (g.tailleMo > 0) cout << " | " << g.tailleMo << " Mo au total";
+        cout << endl;
+    }
+
+    afficherGroupes("Auteurs les plus representes", rapport.parAuteur, 10);
+    afficherGroupes("Disponibilite par qualite (Video)", rapport.parGroupe[static_cast<size_t>(TypeMedia::Video)], 10);
+    afficherGroupes("Disponibilite par format (Ebook)", rapport.parGroupe[static_cast<size_t>(TypeMedia::Ebook)], 10);
+    afficherGroupes("Editeurs (Audio)", rapport.parGroupe[static_cast<size_t>(TypeMedia::Audio)], 5);
+    afficherGroupes("Voix (AudioBook)", rapport.parGroupe[static_cast<size_t>(TypeMedia::AudioBook)], 5);
+
+    cout << "Durees (Audio/Video/AudioBook) :" << endl;
+    for (size_t c = 0; c < NB_CLASSES_DUREE; c++) {
+        cout << "  " << setw(4) << BORNES_DUREE[c];
+        if (c + 1 < NB_CLASSES_DUREE) cout << " - " << setw(4) << BORNES_DUREE[c + 1] << " min : ";
+        else cout << " min et plus : ";
+        cout << rapport.histoDuree[c] << endl;
+    }
+    cout << "Tailles (Ebook) :" << endl;
+    for (size_t c = 0; c < NB_CLASSES_TAILLE; c++) {
+        cout << "  " << setw(5) << BORNES_TAILLE[c];
+        if (c + 1 < NB_CLASSES_TAILLE) cout << " - " << setw(5) << BORNES_TAILLE[c + 1] << " Mo : ";
+        else cout << " Mo et plus : ";
+        cout << rapport.histoTaille[c] << endl;
+    }
+    cout << defaultfloat << setprecision(6);
+}
+
+// Paresseux: a l'ouverture seuls id/type/dispo/ligne sont indexes.
+// Complet: tous les medias sont construits au chargement.
+enum class ModeChargement { Complet, Paresseux };
+
+class Bibliotheque {
+private:
+    // Les medias appartiennent aux pools; le catalogue ne garde que des pointeurs
+    // non possedants, valides tant que la Bibliotheque existe.
+    AreneChaines chaines;
+    size_t octetsMortsArene = 0;      // copies de l'arene que plus aucune fiche ne reference
+    tuple<PoolObjets<Livre>, PoolObjets<Video>, PoolObjets<Audio>,
+          PoolObjets<Ebook>, PoolObjets<AudioBook>> pools;
+    string nomFichier = "bibliotheque.txt";
+    vector<unique_ptr<string>> fichiersBruts;   // contenus charges, references par les fiches
+    vector<Fiche> catalogue;
+    IndexIds positions;
+    ModeChargement mode = ModeChargement::Paresseux;
+
+    StatsCatalogue stats;             // calcule a la premiere demande, puis tenu a jour
+    bool statsAJour = false;
+
+    // Rechargement a chaud: etat du fichier a la derniere synchronisation
+    unique_ptr<SurveillanceFichier> surveillance;
+    PolitiqueConflit politique = PolitiqueConflit::Fusion;
+    uint64_t empreinteFichier = 0;
+    unordered_set<int> idsSupprimes;  // supprimes en memoire depuis la derniere sauvegarde
+
+    string nomJournalPrets = "prets.txt";
+    Circulation circulation;
+
+    // Positions des fiches de chaque type, reconstruites a la premiere requete
+    // apres un ajout, une suppression ou un reordonnancement du catalogue
+    array<vector<uint32_t>, NB_TYPES_MEDIA> indexTypes;
+    bool indexTypesAJour = false;
+
+    string nomFichierAnalyse = "popularite.txt";
+    AnalyseEmprunts analyse;
+    bool analyseModifiee = false;
+
+    bool modifiee = false;            // a reecrire depuis le chargement ou la derniere sauvegarde
+    uint64_t versionModifs = 0;       // incrementee a chaque modification
+    bool lectureSeule = false;        // replique: ni prets ni popularite (fichiers du primaire)
+
+    // Sauvegarde preparee dont les fichiers ne sont pas encore ecrits. Son
+    // etat n'est applique qu'une fois l'ecriture reussie: en cas d'echec,
+    // la session reste a sauvegarder.
+    struct SauvegardePreparee {
+        vector<pair<int, uint64_t>> empreintes;   // (id, empreinte de la ligne ecrite) si elle change
+        uint64_t empreinteFichier = 0;
+        vector<int> supprimes;                    // idsSupprimes absents du fichier ecrit
+        uint64_t version = 0;                     // versionModifs a la preparation
+        size_t premier = 0, nombre = 0;           // nos fichiers dans l'envoi
+        SuiviEcriture suivi;                      // envoi en arriere-plan, sinon nul
+    };
+    unique_ptr<SauvegardePreparee> sauvegardePreparee;
+
+    TrieSuggestions suggestions;      // titres et auteurs, construit a la premiere suggestion
+    bool suggestionsAJour = false;    // ensuite tenu a jour a chaque ajout/suppression
+
+    vector<string_view> champsTemp;   // tampons reutilises par le decodage et la recherche
+    string cleTemp;
+
+    template <class T>
+    PoolObjets<T>& pool() { return get<PoolObjets<T>>(pools); }
+
+    TitreMedia copierTitre(string_view titre) {
+        TitreMedia t;
+        t.texte = chaines.copier(titre);
+        string cle = normaliserCle(titre);
+        t.cle = (cle == titre) ? t.texte : chaines.copier(cle);   // titre deja normalise: partage
+        return t;
+    }
+
+    // Titre deja stable (dans un fichier charge): seule la cle est copiee si besoin
+    TitreMedia titreEnPlace(string_view titre) {
+        normaliserCleDans(titre, cleTemp);
+        return {titre, cleTemp == titre ? titre : chaines.copier(cleTemp)};
+    }
+
+    // Troisieme champ d'une ligne brute
+    static string_view titreBrut(string_view ligne) {
+        size_t a = ligne.find(';');
+        size_t b = ligne.find(';', a + 1);
+        size_t c = ligne.find(';', b + 1);
+        return ligne.substr(b + 1, c - b - 1);
+    }
+
+    // Construit le media d'une fiche a partir de sa ligne brute, au premier acces
+    Media& materialiser(Fiche& fiche) {
+        if (!fiche.media) {
+            decouperChamps(fiche.ligne, champsTemp);
+            TitreMedia titre = titreEnPlace(champsTemp[2]);
+            selonType(fiche.type, [&](auto traits) {
+                using T = typename decltype(traits)::Classe;
+                fiche.media = apply([&](auto&&... details) -> Media* {
+                                        return pool<T>().creer(fiche.id, titre, fiche.dispo, details...);
+                                    },
+                                    T::lireChamps(champsTemp));
+            });
+            conserverSymboles(*fiche.media, 1);
+        }
+        return *fiche.media;
+    }
+
+    static unique_ptr<string> lireFichierEntier(const string& nom) {
+        ifstream f(nom, ios::binary);
+        if (!f) return nullptr;
+        auto contenu = make_unique<string>();
+        f.seekg(0, ios::end);
+        contenu->resize(static_cast<size_t>(f.tellg()));
+        f.seekg(0, ios::beg);
+        f.read(&(*contenu)[0], static_cast<streamsize>(contenu->size()));
+        return contenu;
+    }
+
+    // Decode type;id;titre;dispo en tete de ligne. Faux si la ligne est invalide.
+    static bool lireEntete(string_view ligne, TypeMedia& type, int& id, bool& dispo) {
+        size_t p1 = ligne.find(';');
+        size_t p2 = ligne.find(';', p1 + 1);
+        size_t p3 = ligne.find(';', p2 + 1);
+        if (p1 == string_view::npos || p2 == string_view::npos || p3 == string_view::npos) return false;
+
+        if (!typeDepuisNom(ligne.substr(0, p1), type)) return false;
+        size_t nbChamps = static_cast<size_t>(count(ligne.begin(), ligne.end(), ';')) + 1;
+        if (nbChamps < operations(type).nbChamps) return false;
+
+        if (from_chars(ligne.data() + p1 + 1, ligne.data() + p2, id).ec != errc()) return false;
+        dispo = ligne.substr(p3 + 1, 1) == "1";
+        return true;
+    }
+
+    // Appelle f(ligne) pour chaque ligne non vide (sans le \r final eventuel)
+    template <class F>
+    static void pourChaqueLigne(string_view contenu, F&& f) {
+        while (!contenu.empty()) {
+            size_t fin = contenu.find('\n');
+            string_view ligne = contenu.substr(0, fin);
+            contenu.remove_prefix(fin == string_view::npos ? contenu.size() : fin + 1);
+            if (!ligne.empty() && ligne.back() == '\r') ligne.remove_suffix(1);
+            if (!ligne.empty()) f(ligne);
+        }
+    }
+
+    // Ligne de la fiche telle qu'elle serait sauvegardee maintenant
+    static void ecrireLigne(const Fiche& fiche, TamponEcriture& t) {
+        if (!fiche.media) {
+            t << fiche.ligne;
+            return;
+        }
+        const Media* media = fiche.media;
+        t << media->getTypeNom() << ';' << media->getId() << ';'
+          << media->getTitre() << ';' << (media->isDispo() ? '1' : '0');
+        operations(media->getType()).ecrireChamps(*media, t);
+    }
+
+    // Drapeau pose par les operations de la session: une ligne chargee dans
+    // une forme non canonique ("12.50", ancien format) n'est pas une
+    // modification pour avoir ete construite
+    static bool modifieeLocalement(const Fiche& fiche) {
+        return fiche.empreinte == 0 || fiche.modifiee;
+    }
+
+    // Ajoute (signe = 1) ou retire (signe = -1) la contribution d'une fiche
+    // aux stats. La duree est lue dans la ligne brute sans construire le media.
+    void comptabiliser(const Fiche& fiche, int signe) {
+        if (!statsAJour) return;
+        const OperationsMedia& ops = operations(fiche.type);
+        stats.total += signe;
+        if (fiche.estDispo()) stats.dispo += signe;
+        if (ops.estLivre) stats.livres += signe;
+        if (ops.aDuree) {
+            LigneRapport r;
+            lireValeurs(fiche, champsTemp, r);
+            stats.duree += signe * r.duree;
+        }
+    }
+
+    // Valeurs de la fiche sans construire le media ni modifier la Bibliotheque
+    static void lireValeurs(const Fiche& fiche, vector<string_view>& champs, LigneRapport& r) {
+        r = LigneRapport{fiche.type, fiche.estDispo(), {}, {}, 0, 0, 0.0};
+        selonType(fiche.type, [&](auto traits) {
+            using T = typename decltype(traits)::Classe;
+            if (fiche.media) {
+                T::remplirRapport(static_cast<const T*>(fiche.media)->champs(), r);
+            } else {
+                decouperChamps(fiche.ligne, champs);
+                T::remplirRapport(T::template lireChamps<string_view>(champs), r);
+            }
+        });
+    }
+
+    // Enregistrement vu par le langage de requetes: la ligne n'est decodee
+    // et le titre normalise qu'au premier predicat qui en a besoin
+    class ContexteFiche {
+    private:
+        const Fiche* fiche = nullptr;
+        vector<string_view> champs;
+        string cle;
+        string tampon;
+        LigneRapport lues;
+        bool ligneLue = false;
+        bool cleLue = false;
+
+    public:
+        void placer(const Fiche& f) {
+            fiche = &f;
+            ligneLue = cleLue = false;
+        }
+        int id() const { return fiche->id; }
+        TypeMedia type() const { return fiche->type; }
+        bool dispo() const { return fiche->estDispo(); }
+
+        const LigneRapport& valeurs() {
+            if (!ligneLue) lireValeurs(*fiche, champs, lues);
+            ligneLue = true;
+            return lues;
+        }
+
+        string_view cleTitre() {
+            if (fiche->media) return fiche->media->getCleTitre();
+            if (!cleLue) normaliserCleDans(titreBrut(fiche->ligne), cle);
+            cleLue = true;
+            return cle;
+        }
+
+        string_view normaliser(string_view texte) {
+            normaliserCleDans(texte, tampon);
+            return tampon;
+        }
+    };
+
+    void reconstruireIndexTypes() {
+        if (indexTypesAJour) return;
+        for (auto& liste : indexTypes) liste.clear();
+        for (uint32_t i = 0; i < catalogue.size(); i++) {
+            indexTypes[static_cast<size_t>(catalogue[i].type)].push_back(i);
+        }
+        indexTypesAJour = true;
+    }
+
+    void libererMedia(Media* media) {
+        conserverSymboles(*media, -1);
+        selonType(media->getType(), [&](auto traits) {
+            using T = typename decltype(traits)::Classe;
+            pool<T>().liberer(static_cast<T*>(media));
+        });
+    }
+
+    // Symboles gardes par un media construit (statistiques de l'internement)
+    static void conserverSymboles(const Media& media, int signe) {
+        selonType(media.getType(), [&](auto traits) {
+            using T = typename decltype(traits)::Classe;
+            apply([signe](const auto&... champ) { (conserverChamp(champ, signe), ...); },
+                  static_cast<const T&>(media).champs());
+        });
+    }
+
+    static bool dansLigne(string_view texte, string_view ligne) {
+        return !ligne.empty() && texte.data() >= ligne.data()
+               && texte.data() + texte.size() <= ligne.data() + ligne.size();
+    }
+
+    // A appeler avant de retirer ou remplacer une fiche: ses copies dans
+    // l'arene (ligne repliquee, titre et cle) deviennent inutiles
+    void oublierCopies(const Fiche& fiche) {
+        if (chaines.contient(fiche.ligne)) octetsMortsArene += fiche.ligne.size();
+        if (!fiche.media) return;
+        string_view titre = fiche.media->getTitre(), cle = fiche.media->getCleTitre();
+        if (!dansLigne(titre, fiche.ligne) && chaines.contient(titre)) octetsMortsArene += titre.size();
+        if (cle.data() != titre.data() && chaines.contient(cle)) octetsMortsArene += cle.size();
+    }
+
+    // Recopie les chaines encore referencees dans une arene neuve quand les
+    // copies mortes depassent la moitie de l'arene (et 1 Mo): la memoire
+    // reste proportionnelle au catalogue, pour un cout amorti constant
+    void compacterAreneSiNecessaire() {
+        constexpr size_t SEUIL_MIN = 1 << 20;
+        if (octetsMortsArene < SEUIL_MIN || octetsMortsArene * 2 < chaines.taille()) return;
+        AreneChaines nouvelle;
+        for (auto& fiche : catalogue) {
+            string_view ancienne = fiche.ligne;
+            if (chaines.contient(ancienne)) fiche.ligne = nouvelle.copier(ancienne);
+            if (!fiche.media) continue;
+            string_view titre = fiche.media->getTitre(), cle = fiche.media->getCleTitre();
+            TitreMedia t{titre, cle};
+            if (dansLigne(titre, ancienne)) t.texte = fiche.ligne.substr(titre.data() - ancienne.data(), titre.size());
+            else if (chaines.contient(titre)) t.texte = nouvelle.copier(titre);
+            if (cle.data() == titre.data()) t.cle = t.texte;
+            else if (chaines.contient(cle)) t.cle = nouvelle.copier(cle);
+            fiche.media->deplacerTitre(t);
+        }
+        chaines = move(nouvelle);
+        octetsMortsArene = 0;
+    }
+
+    // Retire une fiche des compteurs et des index secondaires avant de l'effacer
+    void enleverFiche(Fiche& fiche) {
+        comptabiliser(fiche, -1);
+        indexerSuggestions(fiche, false);
+        oublierCopies(fiche);
+        if (fiche.media) libererMedia(fiche.media);
+        if (fiche.empreinte != 0) idsSupprimes.insert(fiche.id);
+    }
+
+    // Toutes les fiches de cet id, dans l'ordre, puis reindexation complete
+    void retirerDoublonsId(int id) {
+        auto fin = stable_partition(catalogue.begin(), catalogue.end(),
+                                    [id](const Fiche& fiche) { return fiche.id != id; });
+        for (auto it = fin; it != catalogue.end(); ++it) enleverFiche(*it);
+        catalogue.erase(fin, catalogue.end());
+        positions.reconstruire(catalogue);
+    }
+
+    // Textes proposes en autocompletion pour une fiche: titre, et auteur pour les livres
+    template <class F>
+    void pourTextesSuggestion(const Fiche& fiche, F&& f) {
+        if (fiche.media) {
+            f(fiche.media->getTitre());
+            if (operations(fiche.type).estLivre) f(static_cast<const Livre*>(fiche.media)->getAuteur());
+            return;
+        }
+        decouperChamps(fiche.ligne, champsTemp);
+        f(champsTemp[2]);
+        selonType(fiche.type, [&](auto traits) {
+            using T = typename decltype(traits)::Classe;
+            if constexpr (is_base_of<Livre, T>::value) {
+                f(get<0>(T::lireChamps(champsTemp)).str());   // l'auteur est le premier detail
+            }
+        });
+    }
+
+    void indexerSuggestions(const Fiche& fiche, bool ajout) {
+        if (!suggestionsAJour) return;
+        pourTextesSuggestion(fiche, [&](string_view texte) {
+            if (ajout) suggestions.inserer(texte);
+            else suggestions.retirer(texte);
+        });
+    }
+
+public:
+    static constexpr size_t RESULTATS_MAX = 20;   // resultats affiches par recherche
+
+    Bibliotheque() = default;
+    Bibliotheque(const Bibliotheque&) = delete;
+    Bibliotheque& operator=(const Bibliotheque&) = delete;
+
+    // Les pools rendent leurs dalles sans destructeurs: seuls les compteurs
+    // de l'internement sont a rendre
+    ~Bibliotheque() {
+        for (const auto& fiche : catalogue) {
+            if (fiche.media) conserverSymboles(*fiche.media, -1);
+        }
+    }
+
+    void setModeChargement(ModeChargement m) { mode = m; }
+
+    // Fichiers utilises (chaque partition d'un catalogue reparti a les siens)
+    void nommerFichiers(string catalogueTxt, string journalPrets, string fichierAnalyse) {
+        nomFichier = move(catalogueTxt);
+        nomJournalPrets = move(journalPrets);
+        nomFichierAnalyse = move(fichierAnalyse);
+    }
+
+    void setLectureSeule(bool l) { lectureSeule = l; }
+    bool estModifiee() const { return modifiee; }
+
+    void marquerModifiee() {
+        modifiee = true;
+        versionModifs++;
+    }
+    size_t taille() const { return catalogue.size(); }
+
+    string_view titreDe(int id) const {
+        size_t pos = positions.trouver(id);
+        if (pos == SIZE_MAX) return "(supprime)";
+        const Fiche& fiche = catalogue[pos];
+        return fiche.media ? fiche.media->getTitre() : titreBrut(fiche.ligne);
+    }
+
+    // Construit un media dans le pool de son type (titre copie dans l'arene)
+    // puis l'ajoute au catalogue.
+    template <class T, class... Args>
+    T* creerMedia(int id, string_view titre, Args&&... args) {
+        T* media = pool<T>().creer(id, copierTitre(titre), forward<Args>(args)...);
+        conserverSymboles(*media, 1);
+        ajouterMedia(media);
+        return media;
+    }
+
+    void ajouterMedia(Media* media) {
+        catalogue.push_back({media->getId(), media->getType(), media->isDispo(), true, {}, media, 0});
+        positions.inserer(media->getId(), catalogue.size() - 1);
+        indexerSuggestions(catalogue.back(), true);
+        comptabiliser(catalogue.back(), 1);
+        indexTypesAJour = false;
+        marquerModifiee();
+    }
+
+    void supprimerMedia(int id) {
+        if (retirerMedia(id)) {
+            circulation.oublierMedia(id);
+            cout << ">> Media ID " << id << " supprime." << endl;
+        } else {
+            cout << ">> ID introuvable." << endl;
+        }
+    }
+
+    // Retire le media du catalogue et des index, sans message. Faux si absent.
+    // La derniere fiche prend sa place: l'ordre du catalogue (et du fichier)
+    // n'est pas conserve, mais la suppression est en O(1).
+    bool retirerMedia(int id) {
+        size_t pos = positions.trouver(id);
+        if (pos == SIZE_MAX) return false;
+        if (positions.taille() != catalogue.size()) {
+            retirerDoublonsId(id);   // fichier edite a la main: l'id peut etre present plusieurs fois
+        } else {
+            enleverFiche(catalogue[pos]);
+            positions.retirer(id);
+            if (pos != catalogue.size() - 1) {
+                catalogue[pos] = catalogue.back();
+                positions.deplacer(catalogue[pos].id, pos);
+            }
+            catalogue.pop_back();
+        }
+        indexTypesAJour = false;
+        marquerModifiee();
+        compacterAreneSiNecessaire();
+        return true;
+    }
+
+    // Ajoute le media decrit par une ligne au format du fichier, ou remplace
+    // celui de meme id (replication). La ligne est copiee dans l'arene.
+    bool remplacerLigne(string_view ligne) {
+        TypeMedia type;
+        int id;
+        bool dispo;
+        if (!lireEntete(ligne, type, id, dispo)) return false;
+        Fiche nouvelle{id, type, dispo, true, chaines.copier(ligne), nullptr, 0};   // 0: pas encore dans le fichier
+
+        size_t pos = positions.trouver(id);
+        if (pos == SIZE_MAX) {
+            catalogue.push_back(nouvelle);
+            positions.inserer(id, catalogue.size() - 1);
+            pos = catalogue.size() - 1;
+        } else {
+            Fiche& fiche = catalogue[pos];
+            comptabiliser(fiche, -1);
+            indexerSuggestions(fiche, false);
+            oublierCopies(fiche);
+            if (fiche.media) libererMedia(fiche.media);
+            fiche = nouvelle;
+        }
+        if (mode == ModeChargement::Complet) materialiser(catalogue[pos]);
+        indexerSuggestions(catalogue[pos], true);
+        comptabiliser(catalogue[pos], 1);
+        indexTypesAJour = false;
+        marquerModifiee();
+        compacterAreneSiNecessaire();
+        return true;
+    }
+
+    // Texte compare par la detection des doublons: titre puis auteur (editeur
+    // pour l'Audio), normalises. Lecture seule: sur dans plusieurs fils.
+    void texteDoublon(size_t pos, vector<string_view>& champs, string& tampon, string& sortie) const {
+        const Fiche& fiche = catalogue[pos];
+        LigneRapport r;
+        lireValeurs(fiche, champs, r);
+        normaliserCleDans(fiche.media ? fiche.media->getTitre() : titreBrut(fiche.ligne), sortie);
+        string_view second = r.type == TypeMedia::Audio ? r.groupe : r.auteur;
+        if (second.empty()) return;
+        normaliserCleDans(second, tampon);
+        sortie += ' ';
+        sortie += tampon;
+    }
+
+    bool texteDoublonDe(int id, string& sortie) {
+        size_t pos = positions.trouver(id);
+        if (pos == SIZE_MAX) return false;
+        string tampon;
+        texteDoublon(pos, champsTemp, tampon, sortie);
+        return true;
+    }
+
+    // Ligne actuelle du media, telle qu'elle serait sauvegardee. Faux si absent.
+    bool ligneDe(int id, TamponEcriture& t) const {
+        size_t pos = positions.trouver(id);
+        if (pos == SIZE_MAX) return false;
+        ecrireLigne(catalogue[pos], t);
+        return true;
+    }
+
+    // Appelle f(ligne) pour chaque media, dans l'ordre du catalogue, avec sa
+    // ligne telle qu'elle serait sauvegardee (un seul tampon reutilise)
+    template <class F>
+    void parcourirLignes(F&& f) const {
+        TamponEcriture t;
+        for (const Fiche& fiche : catalogue) {
+            t.vider();
+            ecrireLigne(fiche, t);
+            f(string_view(t.contenu()));
+        }
+    }
+
+    // Media d'un id (construit si besoin), ou nullptr
+    Media* trouver(int id) {
+        size_t pos = positions.trouver(id);
+        return pos == SIZE_MAX ? nullptr : &materialiser(catalogue[pos]);
+    }
+
+    // Recherche classee: ne garde que les k meilleurs resultats dans un tas borne
+    // (O(n log k)). Le filtre "disponibles seulement" est applique pendant le parcours.
+    // Les fiches non construites sont comparees sur leur ligne brute; seuls les
+    // k resultats finaux sont construits.
+    vector<ResultatRecherche> rechercherClassement(const string& motCle, size_t k,
+                                                   bool dispoSeulement = false,
+                                                   size_t* nbCorrespondances = nullptr) {
+        const string cle = normaliserCle(motCle);
+        // Le sommet du tas est le moins bon des k resultats retenus
+        auto pire = [](const ResultatRecherche& a, const ResultatRecherche& b) { return a.meilleurQue(b); };
+        priority_queue<ResultatRecherche, vector<ResultatRecherche>, decltype(pire)> tas(pire);
+        size_t total = 0;
+
+        if (k > 0) {
+            for (size_t i = 0; i < catalogue.size(); i++) {
+                const Fiche& fiche = catalogue[i];
+                bool dispo = fiche.estDispo();
+                if (dispoSeulement && !dispo) continue;
+
+                string_view cleTitre;
+                if (fiche.media) {
+                    cleTitre = fiche.media->getCleTitre();
+                } else {
+                    normaliserCleDans(titreBrut(fiche.ligne), cleTemp);
+                    cleTitre = cleTemp;
+                }
+                size_t pos = cleTitre.find(cle);
+                if (pos == string::npos) continue;
+                total++;
+
+                ResultatRecherche r{scorerCorrespondance(cleTitre, dispo, cle, pos), i, fiche.id, nullptr};
+                if (tas.size() < k) {
+                    tas.push(r);
+                } else if (r.meilleurQue(tas.top())) {
+                    tas.pop();
+                    tas.push(r);
+                }
+            }
+        }
+
+        vector<ResultatRecherche> resultats(tas.size());
+        for (size_t i = resultats.size(); i-- > 0; tas.pop()) resultats[i] = tas.top();
+        for (auto& r : resultats) r.media = &materialiser(catalogue[r.position]);
+        if (nbCorrespondances) *nbCorrespondances = total;
+        return resultats;
+    }
+
+    void rechercherParTitre(const string& motCle, bool dispoSeulement = false) {
+        cout << "\n--- Resultats Recherche : " << motCle << " ---" << endl;
+        size_t total = 0;
+        auto resultats = rechercherClassement(motCle, RESULTATS_MAX, dispoSeulement, &total);
+        for (const auto& r : resultats) {
+            cout << *r.media << endl;
+        }
+        if (resultats.empty()) cout << "Aucun resultat." << endl;
+        else if (total > resultats.size())
+            cout << "(" << resultats.size() << " meilleurs resultats sur " << total << ")" << endl;
+    }
+
+    vector<string> suggerer(const string& prefixe, size_t k = TrieSuggestions::K, vector<int>* scores = nullptr) {
+        if (!suggestionsAJour) {
+            for (const auto& fiche : catalogue) {
+                pourTextesSuggestion(fiche, [&](string_view texte) { suggestions.inserer(texte); });
+            }
+            suggestionsAJour = true;
+        }
+        return suggestions.suggerer(prefixe, k, scores);
+    }
+
+    // Un emprunt est inscrit au registre des prets au nom de l'emprunteur.
+    // Un retour remet directement le media au premier de sa file d'attente;
+    // avec detenteurSeulement (session Client), seul l'emprunteur peut rendre.
+    void changerStatut(int id, bool emprunt, Symbole emprunteur, bool detenteurSeulement = false) {
+        size_t pos = positions.trouver(id);
+        if (pos == SIZE_MAX) {
+            cout << ">> Media introuvable." << endl;
+            return;
+        }
+        if (!emprunt && detenteurSeulement) {
+            const Pret* pret = circulation.registre().pretDe(id);
+            if (!pret || pret->emprunteur != emprunteur) {
+                cout << ">> Ce media n'est pas emprunte a votre nom." << endl;
+                return;
+            }
+        }
+        Fiche& fiche = catalogue[pos];
+        Media& media = materialiser(fiche);
+        Horodatage debut = maintenant();
+        Horodatage echeance = debut + DUREE_PRET_JOURS * SECONDES_PAR_JOUR;
+        comptabiliser(fiche, -1);
+        if (emprunt) {
+            if (media.emprunter()) {
+                if (suggestionsAJour) suggestions.signalerEmprunt(media.getTitre());
+                circulation.retourner(id);   // pret orphelin (fichier modifie a la main)
+                circulation.annulerReservation(id, emprunteur);
+                circulation.emprunter({id, emprunteur, debut, echeance});
+                analyse.enregistrer(id, debut);
+                analyseModifiee = true;
+                fiche.modifiee = true;
+                marquerModifiee();
+                cout << ">> A rendre avant le " << formaterDate(echeance) << endl;
+            } else {
+                cout << ">> Ce media peut etre reserve." << endl;
+            }
+        } else {
+            Symbole suivant;
+            if (!media.isDispo() && circulation.transmettre(id, debut, echeance, suivant)) {
+                if (suggestionsAJour) suggestions.signalerEmprunt(media.getTitre());
+                analyse.enregistrer(id, debut);
+                analyseModifiee = true;
+                marquerModifiee();
+                cout << ">> Info: '" << media.getTitre() << "' a ete retourne et remis a "
+                     << suivant << " (reservation), a rendre avant le "
+                     << formaterDate(echeance) << "." << endl;
+            } else {
+                media.retourner();
+                circulation.retourner(id);
+                fiche.modifiee = true;
+                marquerModifiee();
+            }
+        }
+        comptabiliser(fiche, 1);
+    }
+
+    // Reservation d'un media indisponible (file FIFO par media)
+    void reserver(int id, Symbole lecteur) {
+        size_t pos = positions.trouver(id);
+        if (pos == SIZE_MAX) {
+            cout << ">> Media introuvable." << endl;
+            return;
+        }
+        const FilesReservations& files = circulation.files();
+        const Pret* pret = circulation.registre().pretDe(id);
+        if (catalogue[pos].estDispo()) {
+            cout << ">> '" << titreDe(id) << "' est disponible: empruntez-le directement." << endl;
+        } else if (pret && pret->emprunteur == lecteur) {
+            cout << ">> Vous avez deja ce media." << endl;
+        } else if (!circulation.reserver(id, lecteur)) {
+            cout << ">> Deja reserve: position " << files.position(id, lecteur) << " dans la file." << endl;
+        } else {
+            cout << ">> Reservation enregistree: position " << files.position(id, lecteur)
+                 << " dans la file." << endl;
+        }
+    }
+
+    void annulerReservation(int id, Symbole lecteur) {
+        if (circulation.annulerReservation(id, lecteur)) cout << ">> Reservation annulee." << endl;
+        else cout << ">> Aucune reservation sur ce media." << endl;
+    }
+
+    const FilesReservations& reservations() const { return circulation.files(); }
+    vector<const Pret*> pretsDe(Symbole emprunteur) { return circulation.registre().pretsDe(emprunteur); }
+    vector<const Pret*> pretsEnRetard(Horodatage t) { return circulation.registre().enRetard(t); }
+    size_t nombrePrets() { return circulation.registre().nombreActifs(); }
+    bool pretEnCours(int id) { return circulation.registre().pretDe(id) != nullptr; }
+    const AnalyseEmprunts& getAnalyse() const { return analyse; }
+
+    void afficherReservationsDe(Symbole lecteur) {
+        const FilesReservations& files = circulation.files();
+        auto ids = files.reservationsDe(lecteur);
+        cout << "\n--- RESERVATIONS DE " << lecteur << " (" << ids.size() << ") ---" << endl;
+        for (int id : ids) {
+            cout << "ID:" << id << " | " << titreDe(id) << " | Position " << files.position(id, lecteur)
+                 << " sur " << files.tailleFile(id) << endl;
+        }
+        if (ids.empty()) cout << "Aucune reservation." << endl;
+    }
+
+    void afficherPretsDe(Symbole emprunteur) {
+        auto liste = circulation.registre().pretsDe(emprunteur);
+        Horodatage t = maintenant();
+        cout << "\n--- EMPRUNTS DE " << emprunteur << " (" << liste.size() << ") ---" << endl;
+        for (const Pret* p : liste) afficherPret(*p, titreDe(p->idMedia), t, false);
+        if (liste.empty()) cout << "Aucun emprunt en cours." << endl;
+    }
+
+    // Requete du langage de requetes. Chemin d'acces: index des ids si un
+    // "id = n" est en conjonction au premier niveau, sinon index par type si un
+    // "type = T" l'est, sinon parcours complet. Les resultats sont affiches au
+    // fil de l'eau (limite = 0: pas de limite). Faux si la requete est invalide.
+    // Avec bilan, le resume final n'est pas affiche mais rendu a l'appelant.
+    bool executerRequete(const string& texte, size_t limite = 0, BilanRequete* bilan = nullptr) {
+        using Genre = NoeudRequete::Genre;
+        AnalyseurRequete analyseur;
+        auto racine = analyseur.analyser(texte);
+        if (!racine) {
+            cout << ">> Requete invalide: " << analyseur.getErreur() << endl;
+            return false;
+        }
+
+        reconstruireIndexTypes();
+        ProfilCatalogue profil;
+        profil.total = catalogue.size();
+        for (size_t t = 0; t < NB_TYPES_MEDIA; t++) profil.parType[t] = indexTypes[t].size();
+        if (statsAJour && stats.total > 0) profil.fractionDispo = static_cast<double>(stats.dispo) / stats.total;
+        planifierNoeud(*racine, profil);
+
+        vector<const NoeudRequete*> conjoints;
+        if (racine->genre == Genre::Et) {
+            for (const auto& e : racine->enfants) conjoints.push_back(e.get());
+        } else {
+            conjoints.push_back(racine.get());
+        }
+        const NoeudRequete* parId = nullptr;
+        const NoeudRequete* parType = nullptr;
+        for (const NoeudRequete* c : conjoints) {
+            if (c->genre != Genre::Predicat || c->op != OpRequete::Egal) continue;
+            if (c->champ->champ == ChampRequete::Id) parId = c;
+            if (c->champ->champ == ChampRequete::Type
+                && (!parType || profil.parType[static_cast<size_t>(c->typeValeur)]
+                                < profil.parType[static_cast<size_t>(parType->typeValeur)])) {
+                parType = c;
+            }
+        }
+        int idCherche = parId ? static_cast<int>(parId->nombre) : 0;
+        const vector<uint32_t>* liste = parType ? &indexTypes[static_cast<size_t>(parType->typeValeur)] : nullptr;
+
+        if (analyseur.explain) {
+            cout << "\n--- PLAN ---" << endl;
+            cout << "Acces : ";
+            if (parId) cout << "index des ids (id = " << idCherche << ")" << endl;
+            else if (parType) cout << "index par type (" << operations(parType->typeValeur).nom << ", "
+                                   << liste->size() << " fiches)" << endl;
+            else cout << "parcours complet (" << catalogue.size() << " fiches)" << endl;
+            cout << "Filtre, dans l'ordre d'evaluation :" << endl;
+            decrireNoeud(*racine, cout, 0);
+            cout << "Resultats estimes : ~" << static_cast<size_t>(racine->selectivite * catalogue.size() + 0.5) << endl;
+            if (bilan) bilan->explain = true;
+            return true;
+        }
+
+        auto debut = chrono::steady_clock::now();
+        ContexteFiche ctx;
+        size_t examinees = 0, trouves = 0;
+        bool tronque = false;
+        auto visiter = [&](size_t pos) {
+            Fiche& fiche = catalogue[pos];
+            ctx.placer(fiche);
+            examinees++;
+            if (!evaluerNoeud(*racine, ctx)) return true;
+            if (limite && trouves == limite) {
+                tronque = true;
+                return false;
+            }
+            trouves++;
+            cout << materialiser(fiche) << endl;
+            return true;
+        };
+
+        if (parId) {
+            size_t pos = positions.trouver(idCherche);
+            if (pos != SIZE_MAX) visiter(pos);
+        } else if (liste) {
+            for (uint32_t pos : *liste) {
+                if (!visiter(pos)) break;
+            }
+        } else {
+            for (size_t pos = 0; pos < catalogue.size(); pos++) {
+                if (!visiter(pos)) break;
+            }
+        }
+
+        if (bilan) {
+            *bilan = {trouves, examinees, tronque, false};
+            return true;
+        }
+        auto us = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - debut).count();
+        if (tronque) cout << "... arret apres " << limite << " resultats (affinez la requete)" << endl;
+        cout << ">> " << trouves << " resultat(s), " << examinees << " fiche(s) examinee(s), "
+             << us << " us" << endl;
+        return true;
+    }
+
+    // Lecture seule et sans construire les medias: sur dans plusieurs fils a la fois
+    AccumulateurRapport calculerRapport(PoolFils& pool) const {
+        return agregerEnParallele(pool, catalogue.size(),
+            [this](size_t i, vector<string_view>& champs, LigneRapport& r) {
+                lireValeurs(catalogue[i], champs, r);
+            });
+    }
+
+    void afficherRapport() {
+        auto debut = chrono::steady_clock::now();
+        AccumulateurRapport rapport = calculerRapport(PoolFils::global());
+        auto ms = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - debut).count();
+        afficherRapportDetaille(rapport, catalogue.size(), ms);
+    }
+
+    void afficherPopularite() {
+        afficherClassementsPopularite(analyse, [this](int id) { return titreDe(id); });
+    }
+
+    void afficherPretsEnRetard() {
+        Horodatage t = maintenant();
+        RegistrePrets& prets = circulation.registre();
+        auto liste = prets.enRetard(t);
+        cout << "\n--- PRETS EN RETARD (" << liste.size() << " sur "
+             << prets.nombreActifs() << " en cours) ---" << endl;
+        for (const Pret* p : liste) afficherPret(*p, titreDe(p->idMedia), t, true);
+        if (liste.empty()) cout << "Aucun pret en retard." << endl;
+    }
+
+    // Range le catalogue par id; mediaA(i) est alors le i-eme plus petit id
+    void trierParId() {
+        stable_sort(catalogue.begin(), catalogue.end(),
+                    [](const Fiche& a, const Fiche& b) {
+                        return a.id < b.id;
+                    });
+        positions.reconstruire(catalogue);
+        indexTypesAJour = false;
+    }
+
+    int idA(size_t pos) const { return catalogue[pos].id; }
+    Media& mediaA(size_t pos) { return materialiser(catalogue[pos]); }
+
+    void afficherTout() {
+        cout << "\n--- CATALOGUE COMPLET (" << catalogue.size() << " medias) ---" << endl;
+        trierParId();
+        for (auto& fiche : catalogue) {
+            cout << materialiser(fiche) << endl;
+        }
+    }
+
+    const StatsCatalogue& statistiques() {
+        if (!statsAJour) {
+            stats = StatsCatalogue();
+            statsAJour = true;
+            for (auto& fiche : catalogue) comptabiliser(fiche, 1);
+        }
+        return stats;
+    }
+
+    void afficherStatistiques() { afficherStatistiquesCatalogue(statistiques()); }
+
+    // Formate tout le catalogue en memoire puis remplace le fichier de facon
+    // atomique. En arriere-plan, seule la mise en forme bloque l'appelant.
+    // Une fiche jamais construite n'a pas pu changer: sa ligne est recopiee.
+    // Si la surveillance est active, les modifications externes sont d'abord
+    // fusionnees pour ne pas les ecraser. Faux si l'ecriture immediate echoue.
+    bool sauvegarderDansFichier(bool arrierePlan = false) {
+        verifierModificationsExternes();   // fusionne d'abord les modifications externes
+
+        vector<pair<string, string>> fichiers;
+        preparerSauvegarde(fichiers);
+        if (arrierePlan) {
+            suivreSauvegarde(EcrivainArrierePlan::global().soumettre(move(fichiers)));
+            cout << ">> Sauvegarde en cours: " << catalogue.size() << " medias" << endl;
+            return true;
+        }
+        EcrivainArrierePlan::global().attendre();
+        if (!appliquerSauvegarde(ecrireFichiers(fichiers))) return false;
+        cout << ">> Catalogue sauvegarde: " << catalogue.size() << " medias" << endl;
+        return true;
+    }
+
+    // Ajoute a fichiers le contenu a ecrire (catalogue, et popularite si elle
+    // a change) sans rien ecrire ni modifier: l'appelant regroupe les
+    // ecritures puis appelle appliquerSauvegarde (suivreSauvegarde en arriere-plan)
+    void preparerSauvegarde(vector<pair<string, string>>& fichiers) {
+        conclureSauvegarde(true);   // une seule sauvegarde preparee a la fois
+        auto prep = make_unique<SauvegardePreparee>();
+        TamponEcriture t;
+        t.reserver(catalogue.size() * 64);
+        for (const auto& fiche : catalogue) {
+            size_t debut = t.taille();
+            ecrireLigne(fiche, t);
+            uint64_t empreinte = empreinteTexte(string_view(t.contenu()).substr(debut));
+            if (empreinte != fiche.empreinte) prep->empreintes.emplace_back(fiche.id, empreinte);
+            t << '\n';
+        }
+        prep->empreinteFichier = empreinteTexte(t.contenu());
+        prep->supprimes.assign(idsSupprimes.begin(), idsSupprimes.end());
+        prep->version = versionModifs;
+        prep->premier = fichiers.size();
+
+        fichiers.emplace_back(nomFichier, t.extraire());
+        if (analyseModifiee) {
+            TamponEcriture a;
+            analyse.ecrire(a);
+            fichiers.emplace_back(nomFichierAnalyse, a.extraire());
+        }
+        prep->nombre = fichiers.size() - prep->premier;
+        sauvegardePreparee = move(prep);
+    }
+
+    // La sauvegarde preparee part en arriere-plan: son resultat sera
+    // applique par conclureSauvegarde
+    void suivreSauvegarde(SuiviEcriture suivi) {
+        if (sauvegardePreparee) sauvegardePreparee->suivi = move(suivi);
+    }
+
+    // ecrits: nombre de fichiers de l'envoi effectivement ecrits. Si les
+    // notres le sont tous, le fichier devient la reference (empreintes,
+    // suppressions, drapeaux); sinon la session reste a sauvegarder.
+    bool appliquerSauvegarde(size_t ecrits) {
+        if (!sauvegardePreparee) return true;
+        unique_ptr<SauvegardePreparee> prep = move(sauvegardePreparee);
+        if (ecrits < prep->premier + prep->nombre) {
+            cerr << ">> ERREUR: '" << nomFichier << "' non sauvegarde, "
+                 << "les modifications restent a sauvegarder." << endl;
+            return false;
+        }
+        for (int id : prep->supprimes) idsSupprimes.erase(id);
+        for (const auto& [id, empreinte] : prep->empreintes) {
+            size_t pos = positions.trouver(id);
+            if (pos != SIZE_MAX) catalogue[pos].empreinte = empreinte;
+            else idsSupprimes.insert(id);   // ecrit, puis supprime pendant l'ecriture
+        }
+        empreinteFichier = prep->empreinteFichier;
+        if (versionModifs == prep->version) {   // rien de neuf depuis la preparation
+            modifiee = false;
+            analyseModifiee = false;
+            for (auto& fiche : catalogue) fiche.modifiee = false;
+        } else {
+            // Le fichier contient maintenant la forme ecrite de chaque fiche:
+            // seules celles changees depuis la preparation en different
+            TamponEcriture t;
+            for (auto& fiche : catalogue) {
+                if (!fiche.modifiee || fiche.empreinte == 0) continue;
+                t.vider();
+                ecrireLigne(fiche, t);
+                fiche.modifiee = empreinteTexte(t.contenu()) != fiche.empreinte;
+            }
+        }
+        return true;
+    }
+
+    // Applique le resultat d'une sauvegarde en arriere-plan. Sans bloquer,
+    // ne fait rien tant que l'ecriture n'est pas terminee.
+    void conclureSauvegarde(bool bloquer) {
+        if (!sauvegardePreparee || !sauvegardePreparee->suivi) return;
+        SuiviEcriture suivi = sauvegardePreparee->suivi;
+        if (suivi->load() < 0) {
+            if (!bloquer) return;
+            EcrivainArrierePlan::global().attendre();
+        }
+        appliquerSauvegarde(static_cast<size_t>(suivi->load()));
+    }
+
+    // Lit le fichier d'un bloc et n'indexe que l'en-tete de chaque ligne
+    // (type, id, dispo); en mode Complet, chaque media est construit aussitot.
+    void chargerDepuisFichier() {
+        EcrivainArrierePlan::global().attendre();   // sauvegarde precedente terminee
+        int count = 0;
+        if (!chargerFichiers(count)) {
+            cout << ">> Info: Catalogue vide. Fichier '" << nomFichier << "' non trouve." << endl;
+        } else if (count > 0) {
+            cout << ">> " << count << " medias charges depuis " << nomFichier << endl;
+        }
+    }
+
+    // Chargement sans affichage ni attente de l'ecrivain: plusieurs
+    // Bibliotheque peuvent charger en parallele. Faux si le catalogue manque.
+    bool chargerFichiers(int& count) {
+        if (!lectureSeule) {
+            circulation.charger(nomJournalPrets);
+            analyse.charger(nomFichierAnalyse);
+        }
+
+        auto contenu = lireFichierEntier(nomFichier);
+        if (!contenu) return false;
+
+        catalogue.reserve(catalogue.size() + std::count(contenu->begin(), contenu->end(), '\n') + 1);
+        count = 0;
+        pourChaqueLigne(*contenu, [&](string_view ligne) {
+            TypeMedia type;
+            int id;
+            bool dispo;
+            if (!lireEntete(ligne, type, id, dispo)) return;
+
+            catalogue.push_back({id, type, dispo, false, ligne, nullptr, empreinteTexte(ligne)});
+            positions.inserer(id, catalogue.size() - 1);
+            if (mode == ModeChargement::Complet) materialiser(catalogue.back());
+            indexerSuggestions(catalogue.back(), true);
+            comptabiliser(catalogue.back(), 1);
+            count++;
+        });
+        empreinteFichier = empreinteTexte(*contenu);
+        fichiersBruts.push_back(move(contenu));
+        indexTypesAJour = false;
+        return true;
+    }
+
+    void setPolitiqueConflit(PolitiqueConflit p) { politique = p; }
+
+    void activerSurveillance() {
+        surveillance = make_unique<SurveillanceFichier>();
+        if (!surveillance->demarrer(nomFichier)) {
+            surveillance.reset();
+            cout << ">> Info: Surveillance de '" << nomFichier << "' indisponible." << endl;
+        }
+    }
+
+    // Non bloquant: applique les modifications externes signalees depuis le dernier appel
+    bool verifierModificationsExternes() {
+        return verifierModificationsExternes([](int) {});
+    }
+
+    template <class F>
+    bool verifierModificationsExternes(F&& avantChangement) {
+        conclureSauvegarde(false);
+        if (!surveillance || !surveillance->changementDetecte()) return false;
+        return recharger(avantChangement);
+    }
+
+    bool recharger() { return recharger([](int) {}); }
+
+    // Compare le fichier au catalogue par id et empreinte de ligne, et n'applique
+    // que les enregistrements changes (index de suggestions et stats compris).
+    // Les anciens contenus restent en memoire: des fiches inchangees y pointent.
+    // avantChangement(id) est appele pour chaque id ajoute, modifie ou
+    // supprime, avant que la fiche ne change.
+    template <class F>
+    bool recharger(F&& avantChangement) {
+        EcrivainArrierePlan::global().attendre();
+        conclureSauvegarde(true);
+        auto contenu = lireFichierEntier(nomFichier);
+        if (!contenu) return false;
+        uint64_t empreinte = empreinteTexte(*contenu);
+        if (empreinte == empreinteFichier) return false;   // notre propre sauvegarde
+
+        struct LigneExterne {
+            TypeMedia type;
+            bool dispo;
+            string_view ligne;
+            uint64_t empreinte;
+            bool vue;
+        };
+        unordered_map<int, LigneExterne> externes;
+        pourChaqueLigne(*contenu, [&](string_view ligne) {
+            TypeMedia type;
+            int id;
+            bool dispo;
+            if (lireEntete(ligne, type, id, dispo)) {
+                externes.emplace(id, LigneExterne{type, dispo, ligne, empreinteTexte(ligne), false});
+            }
+        });
+
+        size_t ajouts = 0, modifications = 0, suppressions = 0, conflits = 0;
+        vector<bool> aSupprimer(catalogue.size(), false);
+
+        for (size_t i = 0; i < catalogue.size(); i++) {
+            Fiche& fiche = catalogue[i];
+            auto it = externes.find(fiche.id);
+
+            if (it == externes.end() || it->second.vue) {
+                if (fiche.empreinte == 0) continue;   // ajout local pas encore sauvegarde
+                if (modifieeLocalement(fiche) && politique != PolitiqueConflit::ExterneGagne) {
+                    conflits++;
+                    fiche.empreinte = 0;   // gardee: sera reecrite a la sauvegarde
+                    continue;
+                }
+                avantChangement(fiche.id);
+                aSupprimer[i] = true;
+                suppressions++;
+                continue;
+            }
+
+            LigneExterne& ext = it->second;
+            ext.vue = true;
+            if (ext.empreinte == fiche.empreinte) continue;   // inchangee dans le fichier
+
+            bool locale = modifieeLocalement(fiche);
+            if (locale) conflits++;
+            if (locale && politique == PolitiqueConflit::LocaleGagne) {
+                fiche.empreinte = ext.empreinte;
+                continue;
+            }
+
+            avantChangement(fiche.id);
+            bool dispoLocale = fiche.estDispo();
+            comptabiliser(fiche, -1);
+            indexerSuggestions(fiche, false);
+            oublierCopies(fiche);
+            if (fiche.media) libererMedia(fiche.media);
+            fiche = Fiche{fiche.id, ext.type, ext.dispo, false, ext.ligne, nullptr, ext.empreinte};
+            if (locale && politique == PolitiqueConflit::Fusion && dispoLocale != ext.dispo) {
+                fiche.dispo = dispoLocale;   // emprunt/retour de la session conserve
+                fiche.modifiee = true;
+                materialiser(fiche);
+            }
+            indexerSuggestions(fiche, true);
+            comptabiliser(fiche, 1);
+            modifications++;
+        }
+
+        if (suppressions > 0) {
+            size_t j = 0;
+            for (size_t i = 0; i < catalogue.size(); i++) {
+                if (aSupprimer[i]) {
+                    comptabiliser(catalogue[i], -1);
+                    indexerSuggestions(catalogue[i], false);
+                    oublierCopies(catalogue[i]);
+                    if (catalogue[i].media) libererMedia(catalogue[i].media);
+                } else {
+                    catalogue[j++] = catalogue[i];
+                }
+            }
+            catalogue.resize(j);
+            positions.reconstruire(catalogue);
+        }
+
+        for (const auto& [id, ext] : externes) {
+            if (ext.vue || idsSupprimes.count(id)) continue;
+            avantChangement(id);
+            catalogue.push_back({id, ext.type, ext.dispo, false, ext.ligne, nullptr, ext.empreinte});
+            positions.inserer(id, catalogue.size() - 1);
+            indexerSuggestions(catalogue.back(), true);
+            comptabiliser(catalogue.back(), 1);
+            ajouts++;
+        }
+
+        empreinteFichier = empreinte;
+        fichiersBruts.push_back(move(contenu));
+        indexTypesAJour = false;
+        if (conflits > 0) marquerModifiee();   // versions locales a reecrire
+        compacterAreneSiNecessaire();
+        cout << "\n>> Fichier '" << nomFichier << "' modifie a l'exterieur: "
+             << ajouts << " ajout(s), " << modifications << " modification(s), "
+             << suppressions << " suppression(s), " << conflits << " conflit(s)" << endl;
+        return ajouts + modifications + suppressions > 0;
+    }
+
+    void verifierFichier() {
+        string cheminComplet = (fs::current_path() / nomFichier).string();
+
+        EcrivainArrierePlan::global().attendre();
+        cout << "\n--- VERIFICATION FICHIER ---" << endl;
+        cout << "Emplacement: " << cheminComplet << endl;
+
+        if (!fs::exists(cheminComplet)) {
+            cout << ">> Le fichier n'existe pas!" << endl;
+            return;
+        }
+
+        ifstream f(nomFichier);
+        if (!f) {
+            cout << ">> Impossible d'ouvrir le fichier en lecture!" << endl;
+            return;
+        }
+
+        auto size = fs::file_size(cheminComplet);
+        cout << "Taille: " << size << " octets" << endl;
+
+        if (size == 0) {
+            cout << ">> Fichier vide!" << endl;
+            f.close();
+            return;
+        }
+
+        cout << "\n--- CONTENU DU FICHIER ---" << endl;
+        string ligne;
+        int numLigne = 0;
+        while (getline(f, ligne)) {
+            numLigne++;
+            cout << numLigne << ": " << ligne << endl;
+        }
+
+        f.close();
+        cout << "--- FIN DU FICHIER ---" << endl;
+        cout << "Total: " << numLigne << " lignes" << endl;
+    }
+};
+
+// ==========================================
+// JOURNAL DES MUTATIONS (REPLICATION)
+// ==========================================
+// Le poste primaire, seul a tenir le verrou mutations.verrou, ajoute a
+// mutations.log l'etat de chaque media modifie:
+//   G;<generation>                                  premiere ligne
+//   <numero>;<instant us>;M;<ligne du media>        ajout ou modification
+//   <numero>;<instant us>;S;<id>                    suppression
+// Chaque ligne porte l'etat complet du media: rejouer tout le journal sur une
+// sauvegarde faite depuis son debut redonne le catalogue du primaire. Le
+// primaire ouvre une nouvelle generation a son demarrage.
+constexpr const char* FICHIER_MUTATIONS = "mutations.log";
+constexpr const char* VERROU_MUTATIONS = "mutations.verrou";
+
+// Microsecondes depuis l'epoque, comparables d'un processus a l'autre
+long long instantMicro() {
+    return chrono::duration_cast<chrono::microseconds>(chrono::system_clock::now().time_since_epoch()).count();
+}
+
+class DiffuseurMutations {
+private:
+    JournalAjout journal;
+    size_t numero = 0;
+#ifdef __unix__
+    int verrou = -1;
+#endif
+
+public:
+    DiffuseurMutations() = default;
+    DiffuseurMutations(const DiffuseurMutations&) = delete;
+    DiffuseurMutations& operator=(const DiffuseurMutations&) = delete;
+
+    ~DiffuseurMutations() {
+#ifdef __unix__
+        if (verrou >= 0) ::close(verrou);   // libere aussi le verrou
+#endif
+    }
+
+    // Faux si un autre processus est deja primaire
+    bool demarrer() {
+#ifdef __unix__
+        verrou = ::open(VERROU_MUTATIONS, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (verrou < 0) return false;
+        if (flock(verrou, LOCK_EX | LOCK_NB) != 0) {
+            ::close(verrou);
+            verrou = -1;
+            return false;
+        }
+#endif
+        journal.ouvrir(FICHIER_MUTATIONS, 0);
+        return journal.reecrire("G;" + to_string(instantMicro()) + "\n", 1);
+    }
+
+    void publierLigne(string_view ligneMedia) { publier('M', ligneMedia); }
+    void publierSuppression(int id) { publier('S', to_string(id)); }
+
+    void publier(char op, string_view donnees) {
+        TamponEcriture t;
+        t << ++numero << ';' << instantMicro() << ';' << op << ';' << donnees << '\n';
+        journal.ecrire(t);
+    }
+};
+
+// Cote replique: lit ce qui a ete ajoute au journal depuis la lecture
+// precedente et mesure le retard de chaque mutation (instant d'application
+// moins instant de publication).
+class LecteurMutations {
+public:
+    enum class Etat { AJour, Nouvelles, NouvelleGeneration, Absent };
+
+private:
+    long long generation = numeric_limits<long long>::min();   // aucune lue
+    uint64_t position = 0;       // octets deja lus
+    string reste;                // ligne incomplete en fin de lecture
+    bool rattrapage = false;     // premiere lecture d'une generation: retards non mesures
+    size_t rejouees = 0;
+    size_t appliquees = 0;
+    size_t dernierNumero = 0;
+    long long dernierRetard = 0, retardMax = 0;
+    long double sommeRetards = 0;
+
+public:
+    // f(op, donnees) pour chaque nouvelle mutation. NouvelleGeneration: le
+    // primaire a redemarre, l'appelant doit recharger les fichiers puis relire.
+    template <class F>
+    Etat lire(F&& f) {
+        ifstream in(FICHIER_MUTATIONS, ios::binary);
+        if (!in) return Etat::Absent;
+        string entete;
+        if (!getline(in, entete) || in.eof()) return Etat::Absent;   // en cours de creation
+        long long g = entete.rfind("G;", 0) == 0 ? lireEntierLong(string_view(entete).substr(2)) : -1;
+        in.seekg(0, ios::end);
+        uint64_t taille = static_cast<uint64_t>(in.tellg());
+        if (g != generation || taille < position) {
+            generation = g;
+            position = entete.size() + 1;
+            reste.clear();
+            rattrapage = true;
+            return Etat::NouvelleGeneration;
+        }
+        bool rejeu = rattrapage;
+        rattrapage = false;
+        if (taille == position) return Etat::AJour;
+
+        string lu(taille - position, '\0');
+        in.seekg(static_cast<streamoff>(position));
+        in.read(&lu[0], static_cast<streamsize>(lu.size()));
+        lu.resize(static_cast<size_t>(in.gcount()));
+        position += lu.size();
+        reste += lu;
+
+        size_t fin = reste.rfind('\n');
+        if (fin == string::npos) return Etat::AJour;
+        long long maintenantUs = instantMicro();
+        string_view complet(reste.data(), fin + 1);
+        while (!complet.empty()) {
+            size_t eol = complet.find('\n');
+            string_view ligne = complet.substr(0, eol);
+            complet.remove_prefix(eol + 1);
+            size_t a = ligne.find(';');
+            size_t b = a == string_view::npos ? a : ligne.find(';', a + 1);
+            if (b == string_view::npos || ligne.size() < b + 3) continue;
+            dernierNumero = static_cast<size_t>(lireEntierLong(ligne.substr(0, a)));
+            f(ligne[b + 1], ligne.substr(b + 3));
+            if (rejeu) {
+                rejouees++;
+                continue;
+            }
+            dernierRetard = maintenantUs - lireEntierLong(ligne.substr(a + 1, b - a - 1));
+            retardMax = max(retardMax, dernierRetard);
+            sommeRetards += dernierRetard;
+            appliquees++;
+        }
+        reste.erase(0, fin + 1);
+        return Etat::Nouvelles;
+    }
+
+    size_t nombreAppliquees() const { return rejouees + appliquees; }
+    long long retardDernier() const { return dernierRetard; }
+
+    void afficherEtat() const {
+        cout << "Generation du journal : " << generation << endl;
+        cout << "Mutations rejouees au chargement : " << rejouees << endl;
+        cout << "Mutations appliquees ensuite : " << appliquees << " (derniere: n." << dernierNumero << ")" << endl;
+        if (appliquees > 0) {
+            cout << "Retard de replication : dernier " << dernierRetard << " us, moyen "
+                 << static_cast<long long>(sommeRetards / appliquees) << " us, max " << retardMax << " us" << endl;
+        }
+    }
+};
+
+// ==========================================
+// CATALOGUE REPARTI EN PARTITIONS
+// ==========================================
+// Les medias sont repartis par hachage de l'id entre N partitions, chacune
+// avec ses fichiers (bibliotheque.k.txt, prets.k.txt, popularite.k.txt),
+// chargeable et sauvegardable seule. N est lu dans bibliotheque.partitions;
+// sans ce fichier, une seule partition sur les noms historiques.
+// Les operations sur un id vont a sa partition; recherches, listes et
+// statistiques interrogent toutes les partitions et fusionnent les resultats.
+class CatalogueReparti {
+private:
+    vector<unique_ptr<Bibliotheque>> parts;
+    unique_ptr<DiffuseurMutations> diffusion;   // poste primaire seulement
+    unique_ptr<IndexDoublons> doublons;         // construit par la premiere detection
+    unique_ptr<AnalyseEmprunts> cumulPopularite;   // fusion des partitions, reutilisee a chaque affichage
+
+    Bibliotheque& partition(int id) { return *parts[partitionDe(id, parts.size())]; }
+
+    // Publie l'etat du media apres une operation ou un rechargement de
+    // fichier (sauvegarde d'une autre session)
+    void publier(int id) {
+        if (!diffusion) return;
+        TamponEcriture t;
+        if (partition(id).ligneDe(id, t)) diffusion->publierLigne(t.contenu());
+        else diffusion->publierSuppression(id);
+    }
+
+    string_view titreDe(int id) { return partition(id).titreDe(id); }
+
+public:
+    static constexpr const char* FICHIER_PARTITIONS = "bibliotheque.partitions";
+    static constexpr size_t PARTITIONS_MAX = 256;
+    static constexpr size_t RESULTATS_MAX = Bibliotheque::RESULTATS_MAX;
+    static constexpr double SEUIL_DOUBLONS = 0.6;   // similarite de Jaccard des trigrammes
+    static constexpr size_t GROUPES_AFFICHES = 20;
+    static constexpr size_t REPRESENTANTS_MAX = 32;   // par seau, detection des doublons
+    static constexpr double MARGE_ESTIMATION = 0.2;   // ~3 ecarts-types de l'estimation sur 48 octets
+
+    // Hachage multiplicatif puis reduction sans modulo: stable d'une execution a l'autre
+    static size_t partitionDe(int id, size_t n) {
+        uint32_t h = static_cast<uint32_t>(id) * 0x9E3779B1u;
+        return static_cast<size_t>((static_cast<uint64_t>(h) * n) >> 32);
+    }
+
+    // Noms des fichiers de la partition k sur n
+    static array<string, 3> nomsPartition(size_t k, size_t n) {
+        if (n == 1) return {"bibliotheque.txt", "prets.txt", "popularite.txt"};
+        string suffixe = "." + to_string(k) + ".txt";
+        return {"bibliotheque" + suffixe, "prets" + suffixe, "popularite" + suffixe};
+    }
+
+    static size_t lireNombrePartitions() {
+        ifstream f(FICHIER_PARTITIONS);
+        long long n = 1;
+        if (!(f >> n) || n < 1 || n > static_cast<long long>(PARTITIONS_MAX)) n = 1;
+        return static_cast<size_t>(n);
+    }
+
+    CatalogueReparti() : CatalogueReparti(lireNombrePartitions()) {}
+
+    explicit CatalogueReparti(size_t n) {
+        for (size_t k = 0; k < n; k++) {
+            auto noms = nomsPartition(k, n);
+            parts.push_back(make_unique<Bibliotheque>());
+            parts.back()->nommerFichiers(noms[0], noms[1], noms[2]);
+        }
+    }
+
+    size_t nombrePartitions() const { return parts.size(); }
+
+    void setModeChargement(ModeChargement m) {
+        for (auto& p : parts) p->setModeChargement(m);
+    }
+
+    void setPolitiqueConflit(PolitiqueConflit pc) {
+        for (auto& p : parts) p->setPolitiqueConflit(pc);
+    }
+
+    // Replique: avant le chargement, pour ne pas toucher aux journaux du primaire
+    void setLectureSeule() {
+        for (auto& p : parts) p->setLectureSeule(true);
+    }
+
+    // Apres le chargement, sessions Admin et SuperAdmin seulement: la premiere
+    // a le demander devient primaire et publie ses mutations aux repliques
+    void activerDiffusion() {
+        auto d = make_unique<DiffuseurMutations>();
+        if (d->demarrer()) {
+            diffusion = move(d);
+            cout << ">> Poste primaire: modifications diffusees dans " << FICHIER_MUTATIONS << endl;
+        } else {
+            cout << ">> Info: Un autre poste est primaire; les modifications de ce poste "
+                 << "n'atteindront les repliques qu'a leur prochain rechargement." << endl;
+        }
+    }
+
+    // Mutation lue dans le journal du primaire (op M: ligne du media, S: id)
+    void appliquerMutation(char op, string_view donnees) {
+        if (op == 'M') {
+            size_t a = donnees.find(';');
+            size_t b = donnees.find(';', a + 1);
+            if (b == string_view::npos) return;
+            int id = lireEntier(donnees.substr(a + 1, b - a - 1));
+            oublierDoublon(id);
+            partition(id).remplacerLigne(donnees);
+            indexerDoublon(id);
+        } else if (op == 'S') {
+            int id = lireEntier(donnees);
+            oublierDoublon(id);
+            partition(id).retirerMedia(id);
+        }
+    }
+
+    // Les partitions sont chargees en parallele
+    void chargerDepuisFichier() {
+        if (parts.size() == 1) {
+            parts[0]->chargerDepuisFichier();
+            return;
+        }
+        EcrivainArrierePlan::global().attendre();
+        vector<int> nombres(parts.size(), 0);
+        vector<char> trouves(parts.size(), 0);
+        PoolFils::global().executer(parts.size(), [&](size_t k, size_t) {
+            trouves[k] = parts[k]->chargerFichiers(nombres[k]);
+        });
+
+        size_t total = 0, presentes = 0;
+        for (size_t k = 0; k < parts.size(); k++) {
+            total += static_cast<size_t>(nombres[k]);
+            presentes += trouves[k];
+        }
+        if (presentes == 0) {
+            cout << ">> Info: Catalogue vide. Aucune des " << parts.size() << " partitions trouvee." << endl;
+        } else if (total > 0) {
+            cout << ">> " << total << " medias charges depuis " << presentes << " partition(s)" << endl;
+        }
+    }
+
+    // Seules les partitions modifiees depuis leur chargement sont reecrites,
+    // toutes dans le meme lot pour l'ecrivain d'arriere-plan
+    bool sauvegarderDansFichier(bool arrierePlan = false) {
+        verifierModificationsExternes();   // avant les partitions: l'index des doublons suit
+        if (parts.size() == 1) return parts[0]->sauvegarderDansFichier(arrierePlan);
+        vector<pair<string, string>> fichiers;
+        size_t total = 0, reecrites = 0;
+        for (auto& p : parts) {
+            p->conclureSauvegarde(true);   // resultat de la sauvegarde precedente
+            total += p->taille();
+            if (!p->estModifiee()) continue;
+            p->preparerSauvegarde(fichiers);
+            reecrites++;
+        }
+
+        if (arrierePlan) {
+            SuiviEcriture suivi = EcrivainArrierePlan::global().soumettre(move(fichiers));
+            for (auto& p : parts) p->suivreSauvegarde(suivi);
+            cout << ">> Sauvegarde en cours: " << total << " medias (" << reecrites
+                 << " partition(s) sur " << parts.size() << " a reecrire)" << endl;
+            return true;
+        }
+        EcrivainArrierePlan::global().attendre();
+        size_t ecrits = ecrireFichiers(fichiers);
+        size_t echecs = 0;
+        for (auto& p : parts) {
+            if (!p->appliquerSauvegarde(ecrits)) echecs++;
+        }
+        if (echecs > 0) {
+            cerr << ">> ERREUR: Sauvegarde incomplete: " << echecs << " partition(s) sur "
+                 << reecrites << " non ecrite(s)." << endl;
+            return false;
+        }
+        cout << ">> Catalogue sauvegarde: " << total << " medias (" << reecrites
+             << " partition(s) sur " << parts.size() << " reecrite(s))" << endl;
+        return true;
+    }
+
+    void activerSurveillance() {
+        for (auto& p : parts) p->activerSurveillance();
+    }
+
+    // Seuls les ids changes dans les fichiers sont retires puis remis dans
+    // l'index des doublons; le primaire les publie aux repliques
+    bool verifierModificationsExternes() {
+        vector<int> changes;
+        for (auto& p : parts) {
+            p->verifierModificationsExternes([&](int id) {
+                oublierDoublon(id);   // texte encore en memoire
+                changes.push_back(id);
+            });
+        }
+        for (int id : changes) {
+            indexerDoublon(id);
+            publier(id);
+        }
+        return !changes.empty();
+    }
+
+    void verifierFichier() {
+        for (auto& p : parts) p->verifierFichier();
+    }
+
+    // --- Operations sur un id: une seule partition ---
+
+    template <class T, class... Args>
+    T* creerMedia(int id, string_view titre, Args&&... args) {
+        T* media = partition(id).creerMedia<T>(id, titre, forward<Args>(args)...);
+        indexerDoublon(id);
+        publier(id);
+        return media;
+    }
+
+    Media* trouver(int id) { return partition(id).trouver(id); }
+
+    void supprimerMedia(int id) {
+        oublierDoublon(id);
+        partition(id).supprimerMedia(id);
+        publier(id);
+    }
+
+    void changerStatut(int id, bool emprunt, Symbole emprunteur, bool detenteurSeulement = false) {
+        partition(id).changerStatut(id, emprunt, emprunteur, detenteurSeulement);
+        publier(id);
+    }
+
+    void reserver(int id, Symbole lecteur) { partition(id).reserver(id, lecteur); }
+    void annulerReservation(int id, Symbole lecteur) { partition(id).annulerReservation(id, lecteur); }
+
+    // --- Operations sur tout le catalogue: fusion des partitions ---
+
+    // Les k meilleurs de chaque partition contiennent les k meilleurs du tout
+    void rechercherParTitre(const string& motCle, bool dispoSeulement = false) {
+        vector<vector<ResultatRecherche>> parPartition(parts.size());
+        vector<size_t> totaux(parts.size(), 0);
+        PoolFils::global().executer(parts.size(), [&](size_t k, size_t) {
+            parPartition[k] = parts[k]->rechercherClassement(motCle, RESULTATS_MAX, dispoSeulement, &totaux[k]);
+        });
+
+        vector<ResultatRecherche> resultats;
+        size_t total = 0;
+        for (size_t k = 0; k < parts.size(); k++) {
+            resultats.insert(resultats.end(), parPartition[k].begin(), parPartition[k].end());
+            total += totaux[k];
+        }
+        size_t garde = min(RESULTATS_MAX, resultats.size());
+        partial_sort(resultats.begin(), resultats.begin() + garde, resultats.end(),
+                     [](const ResultatRecherche& a, const ResultatRecherche& b) { return a.meilleurQue(b); });
+        resultats.resize(garde);
+
+        cout << "\n--- Resultats Recherche : " << motCle << " ---" << endl;
+        for (const auto& r : resultats) {
+            cout << *r.media << endl;
+        }
+        if (resultats.empty()) cout << "Aucun resultat." << endl;
+        else if (total > resultats.size())
+            cout << "(" << resultats.size() << " meilleurs resultats sur " << total << ")" << endl;
+    }
+
+    // Un texte present dans plusieurs partitions cumule ses scores. Un texte
+    // hors du top-k de chaque partition peut manquer: approximation acceptee.
+    vector<string> suggerer(const string& prefixe, size_t k = TrieSuggestions::K) {
+        if (parts.size() == 1) return parts[0]->suggerer(prefixe, k);
+        unordered_map<string, int> cumul;
+        for (auto& p : parts) {
+            vector<int> scores;
+            auto textes = p->suggerer(prefixe, k, &scores);
+            for (size_t i = 0; i < textes.size(); i++) cumul[textes[i]] += scores[i];
+        }
+        vector<pair<int, string>> tries;
+        tries.reserve(cumul.size());
+        for (auto& [texte, score] : cumul) tries.emplace_back(score, texte);
+        sort(tries.begin(), tries.end(), [](const auto& a, const auto& b) {
+            return a.first != b.first ? a.first > b.first : a.second < b.second;
+        });
+        vector<string> resultats;
+        for (size_t i = 0; i < tries.size() && i < k; i++) resultats.push_back(move(tries[i].second));
+        return resultats;
+    }
+
+    void afficherPretsDe(Symbole emprunteur) {
+        vector<const Pret*> liste;
+        for (auto& p : parts) {
+            auto prets = p->pretsDe(emprunteur);
+            liste.insert(liste.end(), prets.begin(), prets.end());
+        }
+        sort(liste.begin(), liste.end(), [](const Pret* a, const Pret* b) { return a->echeance < b->echeance; });
+        Horodatage t = maintenant();
+        cout << "\n--- EMPRUNTS DE " << emprunteur << " (" << liste.size() << ") ---" << endl;
+        for (const Pret* p : liste) afficherPret(*p, titreDe(p->idMedia), t, false);
+        if (liste.empty()) cout << "Aucun emprunt en cours." << endl;
+    }
+
+    void afficherPretsEnRetard() {
+        Horodatage t = maintenant();
+        vector<const Pret*> liste;
+        size_t actifs = 0;
+        for (auto& p : parts) {
+            auto retards = p->pretsEnRetard(t);
+            liste.insert(liste.end(), retards.begin(), retards.end());
+            actifs += p->nombrePrets();
+        }
+        sort(liste.begin(), liste.end(), [](const Pret* a, const Pret* b) { return a->echeance < b->echeance; });
+        cout << "\n--- PRETS EN RETARD (" << liste.size() << " sur " << actifs << " en cours) ---" << endl;
+        for (const Pret* p : liste) afficherPret(*p, titreDe(p->idMedia), t, true);
+        if (liste.empty()) cout << "Aucun pret en retard." << endl;
+    }
+
+    void afficherReservationsDe(Symbole lecteur) {
+        vector<pair<int, const FilesReservations*>> liste;
+        for (auto& p : parts) {
+            const FilesReservations& files = p->reservations();
+            for (int id : files.reservationsDe(lecteur)) liste.emplace_back(id, &files);
+        }
+        cout << "\n--- RESERVATIONS DE " << lecteur << " (" << liste.size() << ") ---" << endl;
+        for (const auto& [id, files] : liste) {
+            cout << "ID:" << id << " | " << titreDe(id) << " | Position " << files->position(id, lecteur)
+                 << " sur " << files->tailleFile(id) << endl;
+        }
+        if (liste.empty()) cout << "Aucune reservation." << endl;
+    }
+
+    // Les esquisses se fusionnent par addition: le classement global est
+    // celui d'une analyse unique ayant vu tous les emprunts
+    void afficherPopularite() {
+        auto titre = [this](int id) { return titreDe(id); };
+        if (parts.size() == 1) {
+            afficherClassementsPopularite(parts[0]->getAnalyse(), titre);
+            return;
+        }
+        if (!cumulPopularite) cumulPopularite = make_unique<AnalyseEmprunts>();
+        cumulPopularite->vider();
+        for (const auto& p : parts) cumulPopularite->fusionner(p->getAnalyse());
+        afficherClassementsPopularite(*cumulPopularite, titre);
+    }
+
+    void afficherRapport() {
+        auto debut = chrono::steady_clock::now();
+        AccumulateurRapport rapport;
+        size_t total = 0;
+        for (auto& p : parts) {
+            rapport.fusionner(p->calculerRapport(PoolFils::global()));
+            total += p->taille();
+        }
+        auto ms = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - debut).count();
+        afficherRapportDetaille(rapport, total, ms);
+    }
+
+    void afficherStatistiques() {
+        StatsCatalogue total;
+        for (auto& p : parts) {
+            const StatsCatalogue& s = p->statistiques();
+            total.total += s.total;
+            total.dispo += s.dispo;
+            total.livres += s.livres;
+            total.duree += s.duree;
+        }
+        afficherStatistiquesCatalogue(total);
+    }
+
+    // Chaque partition est triee par id puis les partitions sont interclassees
+    void afficherTout() {
+        size_t total = 0;
+        for (auto& p : parts) {
+            p->trierParId();
+            total += p->taille();
+        }
+        cout << "\n--- CATALOGUE COMPLET (" << total << " medias) ---" << endl;
+        vector<size_t> curseurs(parts.size(), 0);
+        for (size_t n = 0; n < total; n++) {
+            size_t choisie = SIZE_MAX;
+            for (size_t k = 0; k < parts.size(); k++) {
+                if (curseurs[k] == parts[k]->taille()) continue;
+                if (choisie == SIZE_MAX || parts[k]->idA(curseurs[k]) < parts[choisie]->idA(curseurs[choisie])) {
+                    choisie = k;
                 }
             }
+            cout << parts[choisie]->mediaA(curseurs[choisie]++) << endl;
+        }
+    }
+
+    // Les partitions sont interrogees l'une apres l'autre, la limite portant
+    // sur le total. EXPLAIN affiche le plan de la premiere partition.
+    bool executerRequete(const string& texte, size_t limite = 0) {
+        if (parts.size() == 1) return parts[0]->executerRequete(texte, limite);
+
+        // EXPLAIN: chaque partition choisit son acces selon ses propres effectifs
+        AnalyseurRequete analyseur;
+        if (analyseur.analyser(texte) && analyseur.explain) {
+            for (size_t k = 0; k < parts.size(); k++) {
+                cout << "\n=== Partition " << k + 1 << "/" << parts.size() << " ===";
+                parts[k]->executerRequete(texte);
+            }
+            return true;
+        }
+
+        auto debut = chrono::steady_clock::now();
+        BilanRequete total;
+        for (size_t k = 0; k < parts.size(); k++) {
+            if (limite && total.trouves == limite) {
+                total.tronque = true;
+                break;
+            }
+            BilanRequete b;
+            if (!parts[k]->executerRequete(texte, limite ? limite - total.trouves : 0, &b)) return false;
+            total.trouves += b.trouves;
+            total.examinees += b.examinees;
+            total.tronque |= b.tronque;
+        }
+        auto us = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - debut).count();
+        if (total.tronque) cout << "... arret apres " << limite << " resultats (affinez la requete)" << endl;
+        cout << ">> " << total.trouves << " resultat(s), " << total.examinees << " fiche(s) examinee(s), "
+             << us << " us" << endl;
+        return true;
+    }
+
+    // --- Doublons probables (MinHash / LSH) ---
+
+    // Numero global du premier media de chaque partition, puis le total
+    vector<size_t> debutsPartitions() const {
+        vector<size_t> debuts{0};
+        for (const auto& p : parts) debuts.push_back(debuts.back() + p->taille());
+        return debuts;
+    }
+
+    // Cles LSH de tous les medias en parallele par blocs, l'entree du media g
+    // portant g pour id. signatures (NB_HASH octets par media) si non nul.
+    IndexDoublons::Bandes bandesDoublons(PoolFils& pool, const vector<size_t>& debuts, uint8_t* signatures) {
+        constexpr size_t BLOC = 4096;
+        struct Tampons {
+            vector<string_view> champs;
+            string tampon, texte;
+            vector<uint32_t> tri;
+        };
+        vector<Tampons> tampons(pool.taille());
+        size_t n = debuts.back();
+        IndexDoublons::Bandes bandes;
+        for (auto& b : bandes) b.resize(n);
+        pool.executer((n + BLOC - 1) / BLOC, [&](size_t bloc, size_t fil) {
+            Tampons& t = tampons[fil];
+            size_t k = static_cast<size_t>(upper_bound(debuts.begin(), debuts.end(), bloc * BLOC) - debuts.begin()) - 1;
+            for (size_t g = bloc * BLOC; g < min(n, (bloc + 1) * BLOC); g++) {
+                while (g >= debuts[k + 1]) k++;
+                parts[k]->texteDoublon(g - debuts[k], t.champs, t.tampon, t.texte);
+                IndexDoublons::trigrammes(t.texte, t.tri);
+                IndexDoublons::Cles c = IndexDoublons::cles(t.tri, signatures ? &signatures[g * IndexDoublons::NB_HASH] : nullptr);
+                for (size_t b = 0; b < IndexDoublons::NB_BANDES; b++) bandes[b][g] = {c[b], static_cast<int>(g)};
+            }
+        });
+        return bandes;
+    }
+
+    vector<int> idsGlobaux(const vector<size_t>& debuts) const {
+        vector<int> ids(debuts.back());
+        for (size_t k = 0; k < parts.size(); k++) {
+            for (size_t pos = 0; pos < parts[k]->taille(); pos++) ids[debuts[k] + pos] = parts[k]->idA(pos);
+        }
+        return ids;
+    }
+
+    // Les entrees des bandes portent des numeros globaux: on y met les ids
+    void installerIndexDoublons(IndexDoublons::Bandes&& bandes, const vector<int>& ids) {
+        for (auto& seaux : bandes) {
+            for (auto& e : seaux) e.id = ids[static_cast<size_t>(e.id)];
+        }
+        doublons = make_unique<IndexDoublons>();
+        doublons->construire(move(bandes));
+    }
+
+    // Texte compare du media, en trigrammes. Faux s'il est absent.
+    bool trigrammesDoublon(int id, vector<uint32_t>& tri) {
+        string texte;
+        if (!partition(id).texteDoublonDe(id, texte)) return false;
+        IndexDoublons::trigrammes(texte, tri);
+        return true;
+    }
+
+    // A appeler avant de supprimer ou de remplacer un media: son texte
+    // actuel donne les cles sous lesquelles il est indexe
+    void oublierDoublon(int id) {
+        vector<uint32_t> tri;
+        if (doublons && trigrammesDoublon(id, tri)) doublons->retirer(id, IndexDoublons::cles(tri));
+    }
+
+    // Apres un ajout ou un remplacement
+    void indexerDoublon(int id) {
+        vector<uint32_t> tri;
+        if (doublons && trigrammesDoublon(id, tri)) doublons->ajouter(id, IndexDoublons::cles(tri));
+    }
+
+    // Passe complete en parallele: signatures par blocs de medias, puis tri
+    // et verification des seaux bande par bande, puis regroupement. Dans un
+    // seau, chaque media est compare aux representants deja retenus (au plus
+    // REPRESENTANTS_MAX, cout lineaire) et devient representant s'il ne
+    // ressemble a aucun: un seau peut reunir des medias sans rapport quand
+    // les minimums d'une bande viennent de trigrammes tres frequents. Les
+    // signatures d'octets ecartent la plupart des comparaisons; seules les
+    // paires qui passent ce filtre sont verifiees sur leurs trigrammes.
+    // Groupes d'ids du plus gros au plus petit; l'index construit sert
+    // ensuite a verifier chaque ajout.
+    vector<vector<int>> detecterDoublons(PoolFils& pool, double seuil = SEUIL_DOUBLONS) {
+        using Entree = IndexDoublons::Entree;
+        constexpr size_t NB_BANDES = IndexDoublons::NB_BANDES;
 
-            if (auto video = dynamic_pointer_cast<Video>(media)) {
-                f << ";" << video->getDureeMinutes() << ";" << video->getQualite();
-            }
+        vector<size_t> debuts = debutsPartitions();
+        size_t n = debuts.back();
 
-            if (auto audio = dynamic_pointer_cast<Audio>(media)) {
-                f << ";" << audio->getPublicateur() << ";" << audio->getDureeMinutes();
-            }
+        struct Tampons {
+            vector<string_view> champs;
+            string tampon, texte;
+            vector<uint32_t> tri;
+            vector<pair<uint32_t, vector<uint32_t>>> representants;
+        };
+        vector<Tampons> tampons(pool.taille());
+        // Trigrammes du media numero g (toutes partitions confondues)
+        auto trigrammesDe = [&](size_t g, Tampons& t, vector<uint32_t>& sortie) {
+            size_t k = static_cast<size_t>(upper_bound(debuts.begin(), debuts.end(), g) - debuts.begin()) - 1;
+            parts[k]->texteDoublon(g - debuts[k], t.champs, t.tampon, t.texte);
+            IndexDoublons::trigrammes(t.texte, sortie);
+        };
 
-            if (auto ebook = dynamic_pointer_cast<Ebook>(media)) {
-                f << ";" << ebook->getAuteur() << ";" << ebook->getNpage()
-                  << ";" << ebook->getTailleMo() << ";" << ebook->getFormat();
-            }
+        constexpr size_t NB_HASH = IndexDoublons::NB_HASH;
+        vector<uint8_t> signatures(n * NB_HASH);
+        IndexDoublons::Bandes bandes = bandesDoublons(pool, debuts, signatures.data());
 
-            if (auto audiobook = dynamic_pointer_cast<AudioBook>(media)) {
-                f << ";" << audiobook->getAuteur() << ";" << audiobook->getNpage()
-                  << ";" << audiobook->getPublicateur() << ";" << audiobook->getDureeMinutes();
+        vector<vector<pair<uint32_t, uint32_t>>> paires(NB_BANDES);
+        pool.executer(NB_BANDES, [&](size_t b, size_t fil) {
+            Tampons& t = tampons[fil];
+            vector<Entree>& seaux = bandes[b];
+            sort(seaux.begin(), seaux.end());
+            for (size_t debut = 0, fin; debut < seaux.size(); debut = fin) {
+                for (fin = debut + 1; fin < seaux.size() && seaux[fin].cle == seaux[debut].cle; fin++) {}
+                if (fin - debut < 2) continue;
+                size_t nbRepresentants = 0;
+                for (size_t i = debut; i < fin; i++) {
+                    uint32_t g = static_cast<uint32_t>(seaux[i].id);
+                    bool triLu = false, relie = false;
+                    for (size_t r = 0; r < nbRepresentants && !relie; r++) {
+                        auto& [rg, rtri] = t.representants[r];
+                        if (IndexDoublons::similariteEstimee(&signatures[size_t(rg) * NB_HASH], &signatures[g * NB_HASH])
+                            < seuil - MARGE_ESTIMATION) continue;
+                        if (!triLu) trigrammesDe(g, t, t.tri);
+                        if (rtri.empty()) trigrammesDe(rg, t, rtri);
+                        triLu = true;
+                        relie = IndexDoublons::jaccard(rtri, t.tri) >= seuil;
+                        if (relie) paires[b].emplace_back(rg, g);
+                    }
+                    if (relie || nbRepresentants == REPRESENTANTS_MAX) continue;
+                    if (t.representants.size() == nbRepresentants) t.representants.emplace_back();
+                    t.representants[nbRepresentants].first = g;
+                    t.representants[nbRepresentants].second.clear();
+                    if (triLu) t.representants[nbRepresentants].second.swap(t.tri);
+                    nbRepresentants++;
+                }
             }
+        });
 
-            f << "\n";
+        vector<int> ids = idsGlobaux(debuts);
+        Regroupement groupes(n);
+        for (const auto& liste : paires) {
+            for (const auto& [a, b] : liste) groupes.unir(a, b);
         }
+        unordered_map<uint32_t, vector<int>> parRacine;
+        for (const auto& liste : paires) {
+            for (const auto& pr : liste) {
+                for (uint32_t g : {pr.first, pr.second}) parRacine[groupes.racine(g)].push_back(static_cast<int>(g));
+            }
+        }
+        vector<vector<int>> resultat;
+        for (auto& [racine, membres] : parRacine) {
+            sort(membres.begin(), membres.end());
+            membres.erase(unique(membres.begin(), membres.end()), membres.end());
+            for (int& g : membres) g = ids[static_cast<size_t>(g)];
+            sort(membres.begin(), membres.end());
+            resultat.push_back(move(membres));
+        }
+        sort(resultat.begin(), resultat.end(), [](const vector<int>& a, const vector<int>& b) {
+            return a.size() != b.size() ? a.size() > b.size() : a[0] < b[0];
+        });
 
-        f.close();
-        cout << ">> Catalogue sauvegarde: " << catalogue.size() << " medias" << endl;
+        installerIndexDoublons(move(bandes), ids);
+        return resultat;
     }
 
-    void chargerDepuisFichier() {
-        string nomFichier = "bibliotheque.txt";
-
-        ifstream f(nomFichier);
-        if (!f) {
-            cout << ">> Info: Catalogue vide. Fichier '" << nomFichier << "' non trouve." << endl;
-            return;
-        }
+    // Index seul, sans chercher les groupes (les cles sans les paires): a
+    // la connexion d'un poste qui ajoute des medias, pour que le premier
+    // ajout ne declenche pas de passe complete. Refait apres un import, tenu
+    // a jour a chaque ajout, suppression ou rechargement du fichier.
+    void preparerDoublons() {
+        vector<size_t> debuts = debutsPartitions();
+        installerIndexDoublons(bandesDoublons(PoolFils::global(), debuts, nullptr), idsGlobaux(debuts));
+    }
 
-        int count = 0;
-        string ligne;
-        while (getline(f, ligne)) {
-            if (ligne.empty()) continue;
+    void afficherDoublons() {
+        auto debut = chrono::steady_clock::now();
+        auto groupes = detecterDoublons(PoolFils::global());
+        auto ms = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - debut).count();
 
-            vector<string> champs;
-            size_t pos = 0;
-            string token;
-            while ((pos = ligne.find(';')) != string::npos) {
-                token = ligne.substr(0, pos);
-                champs.push_back(token);
-                ligne.erase(0, pos + 1);
+        size_t medias = 0;
+        for (const auto& g : groupes) medias += g.size();
+        cout << "\n--- DOUBLONS PROBABLES (" << groupes.size() << " groupe(s), " << medias << " medias, "
+             << PoolFils::global().taille() << " fil(s), " << ms << " ms) ---" << endl;
+        for (size_t i = 0; i < groupes.size() && i < GROUPES_AFFICHES; i++) {
+            cout << "Groupe " << i + 1 << " (" << groupes[i].size() << " medias) :" << endl;
+            for (size_t j = 0; j < groupes[i].size() && j < 10; j++) {
+                if (Media* m = trouver(groupes[i][j])) cout << "  " << *m << endl;
             }
-            champs.push_back(ligne);
+            if (groupes[i].size() > 10) cout << "  ... et " << groupes[i].size() - 10 << " autres" << endl;
+        }
+        if (groupes.empty()) cout << "Aucun doublon probable." << endl;
+        else if (groupes.size() > GROUPES_AFFICHES)
+            cout << "(" << GROUPES_AFFICHES << " plus gros groupes sur " << groupes.size() << ")" << endl;
+    }
 
-            if (champs.size() < 4) continue;
+    // Apres un ajout (deja dans l'index): signale les medias existants trop semblables
+    void signalerDoublons(int id, double seuil = SEUIL_DOUBLONS) {
+        vector<uint32_t> tri, autre;
+        if (!trigrammesDoublon(id, tri)) return;
+        if (!doublons) preparerDoublons();
 
-            string type = champs[0];
-            int id = stoi(champs[1]);
-            string titre = champs[2];
-            bool dispo = (champs[3] == "1");
+        for (int candidat : doublons->candidats(IndexDoublons::cles(tri))) {
+            if (candidat == id || !trigrammesDoublon(candidat, autre)) continue;
+            double similarite = IndexDoublons::jaccard(tri, autre);
+            if (similarite < seuil) continue;
+            cout << ">> Attention: doublon probable de ID:" << candidat << " | " << titreDe(candidat)
+                 << " (similarite " << static_cast<int>(similarite * 100 + 0.5) << "%)" << endl;
+        }
+    }
 
-            if (type == "Livre" && champs.size() >= 6) {
-                string auteur = champs[4];
-                int pages = stoi(champs[5]);
-                ajouterMedia(make_shared<Livre>(id, titre, dispo, auteur, pages));
-                count++;
-            } else if (type == "Video" && champs.size() >= 6) {
-                int duree = stoi(champs[4]);
-                string qualite = champs[5];
-                ajouterMedia(make_shared<Video>(id, titre, dispo, duree, qualite));
-                count++;
-            } else if (type == "Audio" && champs.size() >= 6) {
-                string pub = champs[4];
-                int duree = stoi(champs[5]);
-                ajouterMedia(make_shared<Audio>(id, titre, dispo, pub, duree));
-                count++;
-            } else if (type == "Ebook" && champs.size() >= 8) {
-                string auteur = champs[4];
-                int pages = stoi(champs[5]);
-                double taille = stod(champs[6]);
-                string format = champs[7];
-                ajouterMedia(make_shared<Ebook>(id, titre, auteur, pages, taille, format));
-                count++;
-            } else if (type == "AudioBook" && champs.size() >= 8) {
-                string auteur = champs[4];
-                int pages = stoi(champs[5]);
-                string pub = champs[6];
-                int duree = stoi(champs[7]);
-                ajouterMedia(make_shared<AudioBook>(id, titre, dispo, auteur, pages, pub, duree));
-                count++;
-            }
+    // Tous les medias au format MediaItem du front-end (JSON Lines, ou CSV
+    // si le fichier finit par .csv)
+    bool exporter(const string& chemin) {
+        auto debut = chrono::steady_clock::now();
+        EcrivainEchange sortie(chemin, formatDepuisChemin(chemin), COLONNES_MEDIA, NB_COLONNES_MEDIA);
+        if (!sortie.ouvert()) {
+            cout << ">> Erreur: Impossible de creer " << chemin << endl;
+            return false;
         }
+        vector<string_view> champs;
+        string_view valeurs[NB_COLONNES_MEDIA];
+        uint32_t presents = 0;
+        for (const auto& p : parts) {
+            p->parcourirLignes([&](string_view ligne) {
+                if (valeursMedia(ligne, champs, valeurs, presents)) sortie.ecrire(valeurs, presents);
+            });
+        }
+        size_t octets = sortie.octetsEcrits();
+        if (!sortie.terminer()) {
+            cout << ">> Erreur: Echec de l'ecriture de " << chemin << endl;
+            return false;
+        }
+        auto ms = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - debut).count();
+        cout << ">> " << sortie.nombreEcrits() << " medias exportes vers " << chemin << " ("
+             << octets / 1024 << " Ko, " << ms << " ms)" << endl;
+        return true;
+    }
 
-        f.close();
-        if (count > 0) {
-            cout << ">> " << count << " medias charges depuis " << nomFichier << endl;
+    // Chaque media lu met a jour celui de meme id ou s'ajoute au catalogue (et
+    // part aux repliques). Seules les colonnes presentes dans l'enregistrement
+    // changent; dispo ne change pas tant qu'un pret est en cours. Les
+    // enregistrements invalides sont comptes et ignores. Faux si le fichier
+    // est illisible ou si un enregistrement a ete ignore.
+    bool importer(const string& chemin, size_t* nombre = nullptr) {
+        if (nombre) *nombre = 0;
+        auto debut = chrono::steady_clock::now();
+        LecteurEchange entree(chemin, formatDepuisChemin(chemin), COLONNES_MEDIA, NB_COLONNES_MEDIA);
+        if (!entree.ouvert()) {
+            cout << ">> Erreur: Impossible d'ouvrir " << chemin << endl;
+            return false;
+        }
+        if (entree.colonneManquante(COL_ID) || entree.colonneManquante(COL_TYPE)) {
+            cout << ">> Erreur: Colonnes id et type requises dans l'en-tete de " << chemin << endl;
+            return false;
+        }
+        TamponEcriture ligne, actuelle;
+        vector<string_view> champs;
+        string_view valeurs[NB_COLONNES_MEDIA];
+        string raison;
+        size_t importes = 0, rejetes = 0;
+        int id = 0;
+        while (entree.suivant()) {
+            if (!entree.valide()) {
+                signalerRejet(rejetes, entree.getNumero(), entree.getRaison());
+                continue;
+            }
+            // Valeurs actuelles du media, puis celles de l'enregistrement par-dessus
+            uint32_t presents = 0;
+            actuelle.vider();
+            bool idLu = lireNombreExact(entree.valeur(COL_ID), id);
+            bool existe = idLu && partition(id).ligneDe(id, actuelle)
+                          && valeursMedia(actuelle.contenu(), champs, valeurs, presents);
+            if (!existe) presents = 0;
+            string_view dispoActuelle = existe ? valeurs[COL_DISPO] : "0";
+            for (size_t col = 0; col < NB_COLONNES_MEDIA; col++) {
+                valeurs[col] = entree.present(col) ? entree.valeur(col)
+                             : (presents >> col) & 1 ? valeurs[col] : string_view();
+                if (entree.present(col)) presents |= 1u << col;
+            }
+            if (idLu && partition(id).pretEnCours(id)) {
+                valeurs[COL_DISPO] = dispoActuelle;   // le registre des prets fait foi
+                presents |= 1u << COL_DISPO;
+            }
+            if (!ligneMediaDepuisValeurs(valeurs, presents, ligne, id, raison)) {
+                signalerRejet(rejetes, entree.getNumero(), raison);
+                continue;
+            }
+            partition(id).remplacerLigne(ligne.contenu());
+            publier(id);
+            importes++;
         }
+        if (importes > 0 && doublons) preparerDoublons();   // en lot: moins cher que ligne par ligne
+        auto ms = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - debut).count();
+        cout << ">> " << importes << " medias importes depuis " << chemin << ", " << rejetes << " ignore(s) ("
+             << entree.octetsLus() / 1024 << " Ko, " << ms << " ms)" << endl;
+        if (nombre) *nombre = importes;
+        return rejetes == 0;
     }
 
-    void verifierFichier() {
-        string nomFichier = "bibliotheque.txt";
-        string cheminComplet = (fs::current_path() / nomFichier).string();
+    // Redistribue les fichiers du dossier courant en n partitions: lignes du
+    // catalogue et du journal des prets routees par id (l'ordre par id est
+    // conserve), analyses de popularite fusionnees dans la partition 0. Le
+    // fichier des partitions est ecrit en dernier, puis les anciens supprimes.
+    static bool repartir(size_t n) {
+        if (n < 1 || n > PARTITIONS_MAX) {
+            cerr << ">> ERREUR: Nombre de partitions invalide (1 a " << PARTITIONS_MAX << ")." << endl;
+            return false;
+        }
+        EcrivainArrierePlan::global().attendre();
+        size_t ancien = lireNombrePartitions();
 
-        cout << "\n--- VERIFICATION FICHIER ---" << endl;
-        cout << "Emplacement: " << cheminComplet << endl;
+        vector<TamponEcriture> catalogues(n), journaux(n);
+        AnalyseEmprunts popularite;
+        size_t nbMedias = 0;
+        auto idDe = [](string_view ligne) {
+            size_t a = ligne.find(';');
+            size_t b = ligne.find(';', a + 1);
+            return a == string_view::npos ? -1 : lireEntier(ligne.substr(a + 1, b - a - 1));
+        };
+        auto router = [&](const string& fichier, vector<TamponEcriture>& cibles, size_t* compte) {
+            ifstream f(fichier);
+            string ligne;
+            while (getline(f, ligne)) {
+                if (!ligne.empty() && ligne.back() == '\r') ligne.pop_back();
+                if (ligne.empty()) continue;
+                cibles[partitionDe(idDe(ligne), n)] << ligne << '\n';
+                if (compte) (*compte)++;
+            }
+        };
+        for (size_t k = 0; k < ancien; k++) {
+            auto noms = nomsPartition(k, ancien);
+            router(noms[0], catalogues, &nbMedias);
+            router(noms[1], journaux, nullptr);
+            AnalyseEmprunts a;
+            a.charger(noms[2]);
+            popularite.fusionner(a);
+        }
 
-        if (!fs::exists(cheminComplet)) {
-            cout << ">> Le fichier n'existe pas!" << endl;
-            return;
+        unordered_set<string> nouveaux;
+        for (size_t k = 0; k < n; k++) {
+            auto noms = nomsPartition(k, n);
+            TamponEcriture p;
+            if (k == 0) popularite.ecrire(p);
+            if (!ecrireFichierAtomique(noms[0], catalogues[k].contenu())
+                || !ecrireFichierAtomique(noms[1], journaux[k].contenu())
+                || !ecrireFichierAtomique(noms[2], p.contenu())) {
+                cerr << ">> ERREUR: Impossible d'ecrire la partition " << k << "!" << endl;
+                return false;
+            }
+            nouveaux.insert(noms.begin(), noms.end());
         }
 
-        ifstream f(nomFichier);
-        if (!f) {
-            cout << ">> Impossible d'ouvrir le fichier en lecture!" << endl;
-            return;
+        error_code ec;
+        if (n == 1) {
+            fs::remove(FICHIER_PARTITIONS, ec);
+        } else if (!ecrireFichierAtomique(FICHIER_PARTITIONS, to_string(n) + "\n")) {
+            cerr << ">> ERREUR: Impossible d'ecrire " << FICHIER_PARTITIONS << "!" << endl;
+            return false;
+        }
+        for (size_t k = 0; k < ancien; k++) {
+            for (const string& nom : nomsPartition(k, ancien)) {
+                if (!nouveaux.count(nom)) fs::remove(nom, ec);
+            }
         }
+        cout << ">> " << nbMedias << " medias repartis en " << n << " partition(s)" << endl;
+        return true;
+    }
+};
 
-        auto size = fs::file_size(cheminComplet);
-        cout << "Taille: " << size << " octets" << endl;
+// ==========================================
+// REPLIQUES EN LECTURE SEULE
+// ==========================================
+// Catalogue tenu a jour par le journal du primaire. A chaque nouvelle
+// generation (redemarrage du primaire), les fichiers sont relus et le
+// journal rejoue depuis le debut.
+class RepliqueLecture {
+private:
+    unique_ptr<CatalogueReparti> catalogue;
+    LecteurMutations lecteur;
+    size_t rechargements = 0;
 
-        if (size == 0) {
-            cout << ">> Fichier vide!" << endl;
-            f.close();
-            return;
-        }
+    void recharger() {
+        catalogue = make_unique<CatalogueReparti>();
+        catalogue->setLectureSeule();
+        catalogue->chargerDepuisFichier();
+        rechargements++;
+    }
 
-        cout << "\n--- CONTENU DU FICHIER ---" << endl;
-        string ligne;
-        int numLigne = 0;
-        while (getline(f, ligne)) {
-            numLigne++;
-            cout << numLigne << ": " << ligne << endl;
+public:
+    // Applique les mutations publiees depuis l'appel precedent; rend leur nombre
+    size_t suivre() {
+        size_t avant = lecteur.nombreAppliquees();
+        for (int essai = 0; essai < 3; essai++) {
+            auto etat = lecteur.lire([this](char op, string_view donnees) {
+                catalogue->appliquerMutation(op, donnees);
+            });
+            if (etat == LecteurMutations::Etat::NouvelleGeneration) {
+                recharger();
+                continue;
+            }
+            if (etat == LecteurMutations::Etat::Absent && !catalogue) recharger();   // pas de primaire
+            break;
         }
+        return lecteur.nombreAppliquees() - avant;
+    }
 
-        f.close();
-        cout << "--- FIN DU FICHIER ---" << endl;
-        cout << "Total: " << numLigne << " lignes" << endl;
+    CatalogueReparti& getCatalogue() { return *catalogue; }
+    const LecteurMutations& getLecteur() const { return lecteur; }
+
+    void afficherEtat() const {
+        cout << "\n--- ETAT DE LA REPLICATION ---" << endl;
+        cout << "Rechargements complets : " << rechargements << endl;
+        lecteur.afficherEtat();
     }
 };
 
 // ==========================================
 // MENU AJOUT MEDIA
 // ==========================================
-void menuAjouter(Bibliotheque& biblio) {
+void menuAjouter(CatalogueReparti& biblio) {
     int choixType, id, nPage = 0, duree = 0;
     double tailleMo = 0.0;
     string titre, auteur, format, qualite, pub;
@@ -716,21 +6309,21 @@ void menuAjouter(Bibliotheque& biblio) {
         case 1: {
             cout << "Auteur : "; getline(cin, auteur);
             cout << "Nombre de pages : "; cin >> nPage;
-            biblio.ajouterMedia(make_shared<Livre>(id, titre, true, auteur, nPage));
+            biblio.creerMedia<Livre>(id, titre, true, auteur, nPage);
             break;
         }
         case 2: {
             cout << "Duree (min) : "; cin >> duree;
             viderBuffer();
             cout << "Qualite : "; getline(cin, qualite);
-            biblio.ajouterMedia(make_shared<Video>(id, titre, true, duree, qualite));
+            biblio.creerMedia<Video>(id, titre, true, duree, qualite);
             break;
         }
         case 3: {
             viderBuffer();
             cout << "Publicateur : "; getline(cin, pub);
             cout << "Duree (min) : "; cin >> duree;
-            biblio.ajouterMedia(make_shared<Audio>(id, titre, true, pub, duree));
+            biblio.creerMedia<Audio>(id, titre, true, pub, duree);
             break;
         }
         case 4: {
@@ -740,7 +6333,7 @@ void menuAjouter(Bibliotheque& biblio) {
             cout << "Taille (Mo) : "; cin >> tailleMo;
             viderBuffer();
             cout << "Format : "; getline(cin, format);
-            biblio.ajouterMedia(make_shared<Ebook>(id, titre, auteur, nPage, tailleMo, format));
+            biblio.creerMedia<Ebook>(id, titre, true, auteur, nPage, tailleMo, format);
             break;
         }
         case 5: {
@@ -750,7 +6343,7 @@ void menuAjouter(Bibliotheque& biblio) {
             viderBuffer();
             cout << "Narrateur : "; getline(cin, pub);
             cout << "Duree Audio (min) : "; cin >> duree;
-            biblio.ajouterMedia(make_shared<AudioBook>(id, titre, true, auteur, nPage, pub, duree));
+            biblio.creerMedia<AudioBook>(id, titre, true, auteur, nPage, pub, duree);
             break;
         }
         default:
@@ -758,6 +6351,7 @@ void menuAjouter(Bibliotheque& biblio) {
             return;
     }
     cout << ">> Media ajoute avec succes." << endl;
+    biblio.signalerDoublons(id);
 }
 
 // ==========================================
@@ -839,25 +6433,97 @@ void menuGestionUtilisateurs(GestionUtilisateurs& gestionUsers) {
     }
 }
 
+void menuRequete(CatalogueReparti& biblio) {
+    string texte;
+    cout << "\n--- REQUETE AVANCEE ---" << endl;
+    cout << "Champs : id type dispo titre auteur duree pages taille qualite format publicateur" << endl;
+    cout << "Operateurs : = != < <= > >= ~ (contient), AND OR NOT, parentheses" << endl;
+    cout << "Exemple : type=Video AND duree>=90 AND titre~\"star\" AND dispo" << endl;
+    cout << "(EXPLAIN devant la requete affiche le plan)" << endl;
+    cout << "Requete : ";
+    viderBuffer();
+    getline(cin, texte);
+    biblio.executerRequete(texte, 50);
+}
+
+// ==========================================
+// MENU ECHANGE JSON / CSV (SuperAdmin)
+// ==========================================
+void menuEchange(CatalogueReparti& biblio, GestionUtilisateurs& gestionUsers) {
+    int choix;
+    string chemin;
+    cout << "\n--- ECHANGE AVEC LE FRONT-END WEB ---" << endl;
+    cout << "1. Exporter les medias\n2. Importer des medias" << endl;
+    cout << "3. Exporter les utilisateurs\n4. Importer des utilisateurs" << endl;
+    cout << "Choix : ";
+    if (!(cin >> choix) || choix < 1 || choix > 4) {
+        cin.clear();
+        viderBuffer();
+        cout << ">> Choix invalide!" << endl;
+        return;
+    }
+    viderBuffer();
+    cout << "Fichier (.jsonl = JSON Lines, .csv = CSV) : ";
+    getline(cin, chemin);
+    switch (choix) {
+        case 1: biblio.exporter(chemin); break;
+        case 2: biblio.importer(chemin); break;
+        case 3: exporterUtilisateurs(gestionUsers, chemin); break;
+        default: importerUtilisateurs(gestionUsers, chemin);
+    }
+}
+
 // ==========================================
 // MENUS PAR ROLE
 // ==========================================
-void montrerMenuClient() {
-    Bibliotheque biblio;
+// Guichet (Admin, SuperAdmin): l'emprunt est inscrit au nom du lecteur
+// servi, pas du compte du personnel; un retour est accepte quel que soit
+// l'emprunteur.
+void guichetEmpruntRetour(CatalogueReparti& biblio) {
+    int id, action;
+    cout << "ID du media : "; 
+    cin >> id;
+    cout << "1. Emprunter\n2. Retourner\nChoix : "; 
+    cin >> action;
+    if (action != 1) {
+        biblio.changerStatut(id, false, Symbole());
+        return;
+    }
+    string lecteur;
+    cout << "Emprunteur (username) : ";
+    viderBuffer();
+    getline(cin, lecteur);
+    if (lecteur.empty() || !texteSansSeparateur(lecteur)) {
+        cout << ">> Emprunteur invalide." << endl;
+        return;
+    }
+    biblio.changerStatut(id, true, Symbole(lecteur));
+}
+
+void montrerMenuClient(const Utilisateur& user) {
+    CatalogueReparti biblio;
     int choix = -1;
 
     cout << "\n===================================" << endl;
     cout << "  BIBLIOTHEQUE MULTIMEDIA (CLIENT)" << endl;
     cout << "===================================" << endl;
 
+    Symbole moi(user.getUsername());
     biblio.chargerDepuisFichier();
+    biblio.activerSurveillance();   // pas de diffusion: le poste primaire reste celui d'un Admin
 
     while (choix != 0) {
+        biblio.verifierModificationsExternes();
         cout << "\n--- MENU CLIENT ---" << endl;
         cout << "1. Afficher tout le catalogue" << endl;
         cout << "2. Rechercher un media" << endl;
         cout << "3. Emprunter un media" << endl;
         cout << "4. Retourner un media" << endl;
+        cout << "5. Suggestions (autocompletion)" << endl;
+        cout << "6. Mes emprunts" << endl;
+        cout << "7. Reserver un media" << endl;
+        cout << "8. Mes reservations" << endl;
+        cout << "9. Annuler une reservation" << endl;
         cout << "0. Deconnexion" << endl;
         cout << "Votre choix : ";
 
@@ -878,25 +6544,58 @@ void montrerMenuClient() {
                 cout << "Mot du titre : ";
                 viderBuffer();
                 getline(cin, motCle);
-                biblio.rechercherParTitre(motCle);
+                biblio.rechercherParTitre(motCle, demanderOuiNon("Disponibles seulement ?"));
                 break;
             }
             case 3: {
                 int id;
                 cout << "ID du media a emprunter : "; 
                 cin >> id;
-                biblio.changerStatut(id, true);
+                biblio.changerStatut(id, true, moi);
                 break;
             }
             case 4: {
                 int id;
                 cout << "ID du media a retourner : "; 
                 cin >> id;
-                biblio.changerStatut(id, false);
+                biblio.changerStatut(id, false, moi, true);
+                break;
+            }
+            case 5: {
+                string prefixe;
+                cout << "Debut du titre ou de l'auteur : ";
+                viderBuffer();
+                getline(cin, prefixe);
+                auto debut = chrono::steady_clock::now();
+                auto propositions = biblio.suggerer(prefixe);
+                auto us = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - debut).count();
+                for (const auto& texte : propositions) cout << "  " << texte << endl;
+                if (propositions.empty()) cout << "Aucune suggestion." << endl;
+                cout << "(" << us << " us)" << endl;
+                break;
+            }
+            case 6:
+                biblio.afficherPretsDe(moi);
+                break;
+            case 7: {
+                int id;
+                cout << "ID du media a reserver : ";
+                cin >> id;
+                biblio.reserver(id, moi);
+                break;
+            }
+            case 8:
+                biblio.afficherReservationsDe(moi);
+                break;
+            case 9: {
+                int id;
+                cout << "ID de la reservation a annuler : ";
+                cin >> id;
+                biblio.annulerReservation(id, moi);
                 break;
             }
             case 0:
-                biblio.sauvegarderDansFichier();
+                biblio.sauvegarderDansFichier(true);
                 cout << "\n>> Deconnexion..." << endl;
                 break;
             default:
@@ -907,7 +6606,7 @@ void montrerMenuClient() {
 }
 
 void montrerMenuAdmin() {
-    Bibliotheque biblio;
+    CatalogueReparti biblio;
     int choix = -1;
 
     cout << "\n===================================" << endl;
@@ -915,8 +6614,12 @@ void montrerMenuAdmin() {
     cout << "===================================" << endl;
 
     biblio.chargerDepuisFichier();
+    biblio.preparerDoublons();   // chaque ajout est compare au catalogue
+    biblio.activerSurveillance();
+    biblio.activerDiffusion();
 
     while (choix != 0) {
+        biblio.verifierModificationsExternes();
         cout << "\n--- MENU ADMINISTRATEUR ---" << endl;
         cout << "1. Afficher tout le catalogue" << endl;
         cout << "2. Ajouter un media" << endl;
@@ -924,6 +6627,9 @@ void montrerMenuAdmin() {
         cout << "4. Emprunter / Retourner" << endl;
         cout << "5. Supprimer un media" << endl;
         cout << "6. Voir les statistiques" << endl;
+        cout << "7. Prets en retard" << endl;
+        cout << "8. Rapport detaille" << endl;
+        cout << "9. Requete avancee" << endl;
         cout << "0. Deconnexion" << endl;
         cout << "Votre choix : ";
 
@@ -943,18 +6649,12 @@ void montrerMenuAdmin() {
                 cout << "Mot du titre : ";
                 viderBuffer();
                 getline(cin, motCle);
-                               biblio.rechercherParTitre(motCle);
+                biblio.rechercherParTitre(motCle, demanderOuiNon("Disponibles seulement ?"));
                 break;
             }
-            case 4: {
-                int id, action;
-                cout << "ID du media : "; 
-                cin >> id;
-                cout << "1. Emprunter\n2. Retourner\nChoix : "; 
-                cin >> action;
-                biblio.changerStatut(id, (action == 1));
+            case 4:
+                guichetEmpruntRetour(biblio);
                 break;
-            }
             case 5: {
                 int id;
                 cout << "ID a supprimer : "; 
@@ -965,8 +6665,17 @@ void montrerMenuAdmin() {
             case 6: 
                 biblio.afficherStatistiques(); 
                 break;
+            case 7:
+                biblio.afficherPretsEnRetard();
+                break;
+            case 8:
+                biblio.afficherRapport();
+                break;
+            case 9:
+                menuRequete(biblio);
+                break;
             case 0:
-                biblio.sauvegarderDansFichier();
+                biblio.sauvegarderDansFichier(true);
                 cout << "\n>> Deconnexion..." << endl;
                 break;
             default:
@@ -977,7 +6686,7 @@ void montrerMenuAdmin() {
 }
 
 void montrerMenuSuperAdmin(GestionUtilisateurs& gestionUsers) {
-    Bibliotheque biblio;
+    CatalogueReparti biblio;
     int choix = -1;
 
     cout << "\n===================================" << endl;
@@ -986,8 +6695,12 @@ void montrerMenuSuperAdmin(GestionUtilisateurs& gestionUsers) {
     cout << "Repertoire courant: " << fs::current_path() << endl;
 
     biblio.chargerDepuisFichier();
+    biblio.preparerDoublons();   // chaque ajout est compare au catalogue
+    biblio.activerSurveillance();
+    biblio.activerDiffusion();
 
     while (choix != 0) {
+        biblio.verifierModificationsExternes();
         cout << "\n--- MENU SUPER ADMINISTRATEUR ---" << endl;
         cout << "1. Afficher tout le catalogue" << endl;
         cout << "2. Ajouter un media" << endl;
@@ -997,6 +6710,12 @@ void montrerMenuSuperAdmin(GestionUtilisateurs& gestionUsers) {
         cout << "6. Voir les statistiques" << endl;
         cout << "7. Verifier le fichier de sauvegarde" << endl;
         cout << "8. Gestion des utilisateurs" << endl;
+        cout << "9. Prets en retard" << endl;
+        cout << "10. Popularite des emprunts (semaine / mois / tendances)" << endl;
+        cout << "11. Rapport detaille" << endl;
+        cout << "12. Requete avancee" << endl;
+        cout << "13. Doublons probables" << endl;
+        cout << "14. Export / import JSON ou CSV (front-end web)" << endl;
         cout << "0. Deconnexion" << endl;
         cout << "Votre choix : ";
 
@@ -1020,18 +6739,12 @@ void montrerMenuSuperAdmin(GestionUtilisateurs& gestionUsers) {
                 cout << "Mot du titre : ";
                 viderBuffer();
                 getline(cin, motCle);
-                biblio.rechercherParTitre(motCle);
+                biblio.rechercherParTitre(motCle, demanderOuiNon("Disponibles seulement ?"));
                 break;
             }
-            case 4: {
-                int id, action;
-                cout << "ID du media : "; 
-                cin >> id;
-                cout << "1. Emprunter\n2. Retourner\nChoix : "; 
-                cin >> action;
-                biblio.changerStatut(id, (action == 1));
+            case 4:
+                guichetEmpruntRetour(biblio);
                 break;
-            }
             case 5: {
                 int id;
                 cout << "ID a supprimer : "; 
@@ -1048,8 +6761,27 @@ void montrerMenuSuperAdmin(GestionUtilisateurs& gestionUsers) {
             case 8: 
                 menuGestionUtilisateurs(gestionUsers); 
                 break;
+            case 9:
+                biblio.afficherPretsEnRetard();
+                break;
+            case 10:
+                biblio.afficherStatistiques();
+                biblio.afficherPopularite();
+                break;
+            case 11:
+                biblio.afficherRapport();
+                break;
+            case 12:
+                menuRequete(biblio);
+                break;
+            case 13:
+                biblio.afficherDoublons();
+                break;
+            case 14:
+                menuEchange(biblio, gestionUsers);
+                break;
             case 0:
-                biblio.sauvegarderDansFichier();
+                biblio.sauvegarderDansFichier(true);
                 gestionUsers.sauvegarderUtilisateurs();
                 cout << "\n>> Deconnexion..." << endl;
                 break;
@@ -1060,10 +6792,451 @@ void montrerMenuSuperAdmin(GestionUtilisateurs& gestionUsers) {
     }
 }
 
+// Borne de consultation (projet --replique): lecture seule, sans connexion,
+// tenue a jour par le journal du poste primaire avant chaque commande
+void montrerMenuReplique() {
+    RepliqueLecture replique;
+    int choix = -1;
+
+    cout << "\n===================================" << endl;
+    cout << "  BIBLIOTHEQUE MULTIMEDIA (BORNE)" << endl;
+    cout << "===================================" << endl;
+
+    while (choix != 0) {
+        size_t recues = replique.suivre();
+        if (recues > 0) {
+            cout << ">> " << recues << " modification(s) recue(s) du primaire, retard "
+                 << replique.getLecteur().retardDernier() << " us" << endl;
+        }
+        cout << "\n--- MENU BORNE (LECTURE SEULE) ---" << endl;
+        cout << "1. Afficher tout le catalogue" << endl;
+        cout << "2. Rechercher un media" << endl;
+        cout << "3. Statistiques" << endl;
+        cout << "4. Etat de la replication" << endl;
+        cout << "0. Quitter" << endl;
+        cout << "Votre choix : ";
+
+        if (!(cin >> choix)) {
+            cin.clear();
+            viderBuffer();
+            cout << ">> Choix invalide!" << endl;
+            continue;
+        }
+
+        replique.suivre();
+        CatalogueReparti& biblio = replique.getCatalogue();
+        switch (choix) {
+            case 1:
+                biblio.afficherTout();
+                break;
+            case 2: {
+                string motCle;
+                cout << "Mot du titre : ";
+                viderBuffer();
+                getline(cin, motCle);
+                biblio.rechercherParTitre(motCle, demanderOuiNon("Disponibles seulement ?"));
+                break;
+            }
+            case 3:
+                biblio.afficherStatistiques();
+                break;
+            case 4:
+                replique.afficherEtat();
+                break;
+            case 0:
+                cout << "\n>> Au revoir." << endl;
+                break;
+            default:
+                cout << ">> Choix invalide!" << endl;
+                viderBuffer();
+        }
+    }
+}
+
+// ==========================================
+// MESURES DE PERFORMANCE
+// ==========================================
+// projet --bench-prets [nombre]: registre en memoire seulement (pas de journal)
+void mesurerPrets(size_t nombre) {
+    using horloge = chrono::steady_clock;
+    auto ms = [](horloge::time_point debut) {
+        return chrono::duration<double, milli>(horloge::now() - debut).count();
+    };
+
+    const size_t nbUtilisateurs = max<size_t>(1, nombre / 100);
+    vector<Symbole> utilisateurs;
+    for (size_t u = 0; u < nbUtilisateurs; u++) utilisateurs.emplace_back("lecteur" + to_string(u));
+
+    RegistrePrets registre;
+    Horodatage t0 = maintenant();
+    uint64_t alea = 88172645463325252ull;
+    auto suivant = [&alea]() {
+        alea ^= alea << 13; alea ^= alea >> 7; alea ^= alea << 17;
+        return alea;
+    };
+
+    auto debut = horloge::now();
+    for (size_t i = 0; i < nombre; i++) {
+        // Emprunts etales sur 60 jours: environ un tiers sont encore dans les temps
+        Horodatage emprunt = t0 - static_cast<Horodatage>(suivant() % (60 * SECONDES_PAR_JOUR));
+        registre.emprunter({static_cast<int>(i), utilisateurs[suivant() % nbUtilisateurs],
+                            emprunt, emprunt + DUREE_PRET_JOURS * SECONDES_PAR_JOUR});
+    }
+    cout << nombre << " emprunts : " << ms(debut) << " ms" << endl;
+
+    debut = horloge::now();
+    size_t retards = registre.enRetard(t0).size();
+    cout << "Premier releve des retards (" << retards << ") : " << ms(debut) << " ms" << endl;
+
+    debut = horloge::now();
+    retards = registre.enRetard(t0 + 3600).size();
+    cout << "Releve suivant, une heure plus tard (" << retards << ") : " << ms(debut) << " ms" << endl;
+
+    debut = horloge::now();
+    size_t trouves = 0;
+    for (size_t u = 0; u < 1000; u++) trouves += registre.pretsDe(utilisateurs[u % nbUtilisateurs]).size();
+    cout << "Prets de 1000 lecteurs (" << trouves << " prets) : " << ms(debut) << " ms" << endl;
+
+    debut = horloge::now();
+    for (size_t i = 0; i < nombre; i += 2) registre.retourner(static_cast<int>(i));
+    cout << (nombre + 1) / 2 << " retours : " << ms(debut) << " ms" << endl;
+
+    debut = horloge::now();
+    retards = registre.enRetard(t0 + 7200).size();
+    cout << "Releve apres retours (" << retards << ") : " << ms(debut) << " ms" << endl;
+}
+
+// projet --bench-analyse [nombre]: un flux d'emprunts par fil, puis fusion
+void mesurerAnalyse(size_t nombre) {
+    using horloge = chrono::steady_clock;
+    auto ms = [](horloge::time_point debut) {
+        return chrono::duration<double, milli>(horloge::now() - debut).count();
+    };
+
+    const size_t nbFils = max(1u, thread::hardware_concurrency());
+    const Horodatage t0 = maintenant();
+    vector<AnalyseEmprunts> parFil(nbFils);
+
+    auto debut = horloge::now();
+    vector<thread> fils;
+    for (size_t f = 0; f < nbFils; f++) {
+        fils.emplace_back([&, f]() {
+            uint64_t alea = 88172645463325252ull + f;
+            auto suivant = [&alea]() {
+                alea ^= alea << 13; alea ^= alea >> 7; alea ^= alea << 17;
+                return alea;
+            };
+            for (size_t i = f; i < nombre; i += nbFils) {
+                // Popularite tres inegale: id = 100000^u (loi proche de Zipf)
+                double u = static_cast<double>(suivant() % 1000000) / 1000000.0;
+                int id = static_cast<int>(pow(100000.0, u));
+                Horodatage t = t0 - static_cast<Horodatage>(suivant() % (30 * SECONDES_PAR_JOUR));
+                parFil[f].enregistrer(id, t);
+            }
+        });
+    }
+    for (auto& fil : fils) fil.join();
+    cout << nombre << " emprunts sur " << nbFils << " fils : " << ms(debut) << " ms" << endl;
+
+    debut = horloge::now();
+    for (size_t f = 1; f < nbFils; f++) parFil[0].fusionner(parFil[f]);
+    cout << "Fusion des esquisses : " << ms(debut) << " ms" << endl;
+
+    const AnalyseEmprunts& analyse = parFil[0];
+    const int tours = 1000;
+    debut = horloge::now();
+    size_t trouves = 0;
+    for (int i = 0; i < tours; i++) trouves += analyse.plusEmpruntes(10, 7, t0).size();
+    cout << "Top 10 de la semaine : " << ms(debut) * 1000 / tours << " us" << endl;
+
+    debut = horloge::now();
+    for (int i = 0; i < tours; i++) trouves += analyse.plusEmpruntes(10, 30, t0).size();
+    cout << "Top 10 du mois : " << ms(debut) * 1000 / tours << " us" << endl;
+
+    for (const auto& p : analyse.plusEmpruntes(5, 30, t0)) {
+        cout << "  ID:" << p.id << " ~" << p.emprunts << " emprunts" << endl;
+    }
+    if (trouves == 0) cout << "Aucun resultat." << endl;
+}
+
+// projet --bench-rapport [nombre]: catalogue synthetique dans un dossier
+// temporaire, rapport calcule avec 1, 2, 4... fils
+void mesurerRapport(size_t nombre) {
+    using horloge = chrono::steady_clock;
+    fs::path ancien = fs::current_path();
+    fs::path dossier = fs::temp_directory_path() / "bench_rapport";
+    fs::create_directories(dossier);
+    fs::current_path(dossier);
+
+    {
+        const char* qualites[] = {"SD", "HD", "4K"};
+        const char* formats[] = {"PDF", "EPUB", "MOBI"};
+        TamponEcriture t;
+        t.reserver(nombre * 48);
+        for (size_t i = 0; i < nombre; i++) {
+            int id = static_cast<int>(i + 1);
+            int dispo = i % 3 != 0;
+            string auteur = "Auteur" + to_string(i % 2000);
+            switch (i % 5) {
+                case 0: t << "Livre;" << id << ";Titre " << id << ';' << dispo << ';' << auteur << ';' << static_cast<int>(100 + i % 400); break;
+                case 1: t << "Video;" << id << ";Film " << id << ';' << dispo << ';' << static_cast<int>(20 + i % 200) << ';' << qualites[i % 3]; break;
+                case 2: t << "Audio;" << id << ";Album " << id << ';' << dispo << ";Label" << static_cast<int>(i % 50) << ';' << static_cast<int>(10 + i % 90); break;
+                case 3: t << "Ebook;" << id << ";Ebook " << id << ';' << dispo << ';' << auteur << ';' << static_cast<int>(50 + i % 300)
+                          << ';' << static_cast<double>(i % 2000) / 10.0 << ';' << formats[i % 3]; break;
+                default: t << "AudioBook;" << id << ";Lu " << id << ';' << dispo << ';' << auteur << ';' << static_cast<int>(200 + i % 100)
+                           << ";Voix" << static_cast<int>(i % 30) << ';' << static_cast<int>(60 + i % 600); break;
+            }
+            t << '\n';
+        }
+        ecrireFichierAtomique("bibliotheque.txt", t.contenu());
+    }
+
+    {
+        Bibliotheque biblio;
+        biblio.chargerDepuisFichier();
+        size_t maxFils = max(1u, thread::hardware_concurrency());
+        for (size_t nbFils = 1;; nbFils = min(nbFils * 2, maxFils)) {
+            PoolFils pool(nbFils);
+            double meilleur = 1e18;
+            uint64_t total = 0;
+            for (int essai = 0; essai < 3; essai++) {
+                auto debut = horloge::now();
+                AccumulateurRapport r = biblio.calculerRapport(pool);
+                meilleur = min(meilleur, chrono::duration<double, milli>(horloge::now() - debut).count());
+                total = 0;
+                for (const auto& g : r.parType) total += g.nombre;
+            }
+            cout << "Rapport avec " << nbFils << " fil(s) : " << meilleur << " ms (" << total << " medias)" << endl;
+            if (nbFils == maxFils) break;
+        }
+    }
+
+    fs::current_path(ancien);
+    fs::remove_all(dossier);
+}
+
+// projet --bench-doublons [nombre]: catalogue synthetique dans un dossier
+// temporaire, dont 1 titre sur 100 est repris sous deux autres ids (faute
+// de frappe, casse differente); mesure la detection avec 1, 2, 4... fils
+void mesurerDoublons(size_t nombre) {
+    using horloge = chrono::steady_clock;
+    fs::path ancien = fs::current_path();
+    fs::path dossier = fs::temp_directory_path() / "bench_doublons";
+    fs::create_directories(dossier);
+    fs::current_path(dossier);
+
+    const char* syllabes[] = {"ba", "lo", "mi", "ra", "tu", "ne", "vo", "sa", "ki", "de",
+                              "pu", "fa", "ze", "ro", "li", "ga", "mo", "ti", "cha", "pre"};
+    uint64_t graine = 42;
+    auto aleatoire = [&graine](size_t borne) {
+        graine = graine * 6364136223846793005ULL + 1442695040888963407ULL;
+        return static_cast<size_t>((graine >> 33) % borne);
+    };
+    auto mot = [&]() {
+        string m;
+        for (size_t s = 0, n = 2 + aleatoire(3); s < n; s++) m += syllabes[aleatoire(20)];
+        return m;
+    };
+
+    size_t injectes = 0;
+    vector<array<int, 3>> attendus;   // original et ses deux variantes
+    {
+        TamponEcriture t;
+        t.reserver(nombre * 48);
+        int id = 1;
+        for (size_t i = 0; i < nombre; i++) {
+            string titre = mot() + ' ' + mot() + ' ' + mot();
+            string auteur = "Auteur" + to_string(aleatoire(5000));
+            t << "Livre;" << id << ';' << titre << ";1;" << auteur << ';' << static_cast<int>(100 + i % 400) << '\n';
+            if (i % 100 == 0) {
+                string faute = titre;
+                swap(faute[faute.size() / 2], faute[faute.size() / 2 + 1]);
+                string casse = titre;
+                casse[0] = static_cast<char>(toupper(static_cast<unsigned char>(casse[0])));
+                t << "Livre;" << id + 1 << ';' << faute << ";1;" << auteur << ";321\n";
+                t << "Livre;" << id + 2 << ';' << casse << ";0;" << auteur << ";123\n";
+                attendus.push_back({id, id + 1, id + 2});
+                injectes += 2;
+                id += 2;
+            }
+            id++;
+        }
+        ecrireFichierAtomique("bibliotheque.txt", t.contenu());
+    }
+
+    {
+        CatalogueReparti biblio(1);
+        biblio.chargerDepuisFichier();
+        size_t maxFils = max(1u, thread::hardware_concurrency());
+        for (size_t nbFils = 1;; nbFils = min(nbFils * 2, maxFils)) {
+            PoolFils pool(nbFils);
+            auto debut = horloge::now();
+            auto groupes = biblio.detecterDoublons(pool);
+            double ms = chrono::duration<double, milli>(horloge::now() - debut).count();
+
+            unordered_map<int, size_t> groupeDe;
+            for (size_t g = 0; g < groupes.size(); g++) {
+                for (int id : groupes[g]) groupeDe[id] = g + 1;
+            }
+            size_t retrouves = 0;
+            for (const auto& a : attendus) {
+                size_t g = groupeDe.count(a[0]) ? groupeDe[a[0]] : 0;
+                if (g && groupeDe[a[1]] == g && groupeDe[a[2]] == g) retrouves++;
+            }
+            cout << "Doublons avec " << nbFils << " fil(s) : " << ms << " ms, " << groupes.size()
+                 << " groupe(s), " << retrouves << "/" << attendus.size() << " groupes injectes retrouves"
+                 << " (" << nombre + injectes << " medias)" << endl;
+            if (nbFils == maxFils) break;
+        }
+        auto debut = horloge::now();
+        biblio.preparerDoublons();
+        cout << "Index seul (connexion d'un Admin) avec " << PoolFils::global().taille() << " fil(s) : "
+             << chrono::duration<double, milli>(horloge::now() - debut).count() << " ms" << endl;
+    }
+
+    fs::current_path(ancien);
+    fs::remove_all(dossier);
+}
+
+// projet --bench-echange [nombre]: exporte un catalogue synthetique (titres
+// avec virgules et guillemets) en JSON Lines et en CSV, reimporte chaque
+// fichier dans un catalogue vide et verifie que sa reexportation est identique
+void mesurerEchange(size_t nombre) {
+    using horloge = chrono::steady_clock;
+    fs::path ancien = fs::current_path();
+    fs::path dossier = fs::temp_directory_path() / "bench_echange";
+    fs::create_directories(dossier);
+    fs::current_path(dossier);
+
+    {
+        const char* qualites[] = {"SD", "HD", "4K"};
+        TamponEcriture t;
+        t.reserver(nombre * 48);
+        for (size_t i = 0; i < nombre; i++) {
+            int id = static_cast<int>(i + 1);
+            int dispo = i % 3 != 0;
+            string auteur = "Auteur" + to_string(i % 2000);
+            switch (i % 5) {
+                case 0: t << "Livre;" << id << ";Titre " << id << ", tome " << static_cast<int>(i % 7) << ';' << dispo << ';' << auteur << ';' << static_cast<int>(100 + i % 400); break;
+                case 1: t << "Video;" << id << ";Film \"" << id << "\";" << dispo << ';' << static_cast<int>(20 + i % 200) << ';' << qualites[i % 3]; break;
+                case 2: t << "Audio;" << id << ";Album " << id << ';' << dispo << ";Label" << static_cast<int>(i % 50) << ';' << static_cast<int>(10 + i % 90); break;
+                case 3: t << "Ebook;" << id << ";Ebook " << id << ';' << dispo << ';' << auteur << ';' << static_cast<int>(50 + i % 300)
+                          << ';' << static_cast<double>(i % 2000) / 10.0 << ";PDF"; break;
+                default: t << "AudioBook;" << id << ";L\u00e9gende " << id << ';' << dispo << ';' << auteur << ';' << static_cast<int>(200 + i % 100)
+                           << ";Voix" << static_cast<int>(i % 30) << ';' << static_cast<int>(60 + i % 600); break;
+            }
+            t << '\n';
+        }
+        ecrireFichierAtomique("bibliotheque.txt", t.contenu());
+    }
+
+    auto lireTout = [](const char* nom) {
+        ifstream f(nom, ios::binary);
+        return string(istreambuf_iterator<char>(f), istreambuf_iterator<char>());
+    };
+    auto mesurer = [](auto&& f) {
+        auto debut = horloge::now();
+        f();
+        return chrono::duration<double, milli>(horloge::now() - debut).count();
+    };
+
+    CatalogueReparti source(1);
+    source.chargerDepuisFichier();
+    for (const char* nom : {"export.jsonl", "export.csv"}) {
+        double msExport = mesurer([&] { source.exporter(nom); });
+        double mo = static_cast<double>(fs::file_size(nom)) / (1 << 20);
+        CatalogueReparti copie(1);
+        double msImport = mesurer([&] { copie.importer(nom); });
+        copie.exporter(string("re") + nom);
+        bool identique = lireTout(nom) == lireTout((string("re") + nom).c_str());
+        cout << nom << " : " << mo << " Mo, export " << msExport << " ms (" << mo * 1000 / msExport
+             << " Mo/s), import " << msImport << " ms (" << mo * 1000 / msImport << " Mo/s), aller-retour "
+             << (identique ? "identique" : "DIFFERENT") << endl;
+    }
+
+    fs::current_path(ancien);
+    fs::remove_all(dossier);
+}
+
 // ==========================================
 // FONCTION PRINCIPALE
 // ==========================================
-int main() {
+int main(int argc, char* argv[]) {
+    if (argc >= 2 && string(argv[1]) == "--bench-prets") {
+        mesurerPrets(argc >= 3 ? static_cast<size_t>(lireEntierLong(argv[2])) : 1000000);
+        return 0;
+    }
+    if (argc >= 2 && string(argv[1]) == "--bench-analyse") {
+        mesurerAnalyse(argc >= 3 ? static_cast<size_t>(lireEntierLong(argv[2])) : 10000000);
+        return 0;
+    }
+    // projet --requete "type=Video AND dispo": sur bibliotheque.txt du dossier
+    // courant, en lecture seule (ni journal des prets ni popularite ouverts)
+    if (argc >= 3 && string(argv[1]) == "--requete") {
+        CatalogueReparti biblio;
+        biblio.setLectureSeule();
+        biblio.chargerDepuisFichier();
+        return biblio.executerRequete(argv[2]) ? 0 : 1;
+    }
+    // projet --exporter medias.jsonl | --importer medias.csv: catalogue du dossier courant
+    if (argc >= 3 && string(argv[1]) == "--exporter") {
+        CatalogueReparti biblio;
+        biblio.chargerDepuisFichier();
+        return biblio.exporter(argv[2]) ? 0 : 1;
+    }
+    // Comme une session Admin: primaire si aucun autre poste ne l'est, pour
+    // que les repliques recoivent l'import (sinon le primaire le publie a son
+    // rechargement du fichier). Code 1 si l'import ou la sauvegarde echoue.
+    if (argc >= 3 && string(argv[1]) == "--importer") {
+        CatalogueReparti biblio;
+        biblio.chargerDepuisFichier();
+        biblio.activerDiffusion();
+        size_t importes = 0;
+        bool ok = biblio.importer(argv[2], &importes);
+        if (importes > 0 && !biblio.sauvegarderDansFichier()) ok = false;
+        return ok ? 0 : 1;
+    }
+    if (argc >= 2 && string(argv[1]) == "--bench-echange") {
+        mesurerEchange(argc >= 3 ? static_cast<size_t>(lireEntierLong(argv[2])) : 1000000);
+        return 0;
+    }
+    if (argc >= 2 && string(argv[1]) == "--bench-doublons") {
+        mesurerDoublons(argc >= 3 ? static_cast<size_t>(lireEntierLong(argv[2])) : 1000000);
+        return 0;
+    }
+    // projet --replique: borne de consultation tenue a jour par le poste primaire
+    if (argc >= 2 && string(argv[1]) == "--replique") {
+        montrerMenuReplique();
+        return 0;
+    }
+    // projet --suivre [secondes]: replique sans menu, affiche chaque lot recu
+    // et son retard, puis l'etat final (pour mesurer la replication)
+    if (argc >= 2 && string(argv[1]) == "--suivre") {
+        long long secondes = argc >= 3 ? lireEntierLong(argv[2]) : 10;
+        RepliqueLecture replique;
+        auto fin = chrono::steady_clock::now() + chrono::seconds(secondes);
+        while (chrono::steady_clock::now() < fin) {
+            size_t recues = replique.suivre();
+            if (recues > 0) {
+                cout << ">> +" << recues << " mutation(s), retard " << replique.getLecteur().retardDernier()
+                     << " us" << endl;
+            } else {
+                this_thread::sleep_for(chrono::milliseconds(1));
+            }
+        }
+        replique.afficherEtat();
+        replique.getCatalogue().afficherStatistiques();
+        return 0;
+    }
+    // projet --repartir 4: redistribue le catalogue du dossier courant en 4 partitions
+    if (argc >= 3 && string(argv[1]) == "--repartir") {
+        return CatalogueReparti::repartir(static_cast<size_t>(lireEntierLong(argv[2]))) ? 0 : 1;
+    }
+    if (argc >= 2 && string(argv[1]) == "--bench-rapport") {
+        mesurerRapport(argc >= 3 ? static_cast<size_t>(lireEntierLong(argv[2])) : 2000000);
+        return 0;
+    }
+
     cout << "==============================================" << endl;
     cout << "  SYSTEME DE GESTION DE BIBLIOTHEQUE V2.0" << endl;
     cout << "==============================================" << endl;
@@ -1078,16 +7251,16 @@ int main() {
         
         // Login avec option de création de compte
         auto user = login(gestionUsers);
-        string role = user->getRole();
+        Symbole role = user->getRoleSymbole();
         
         // Afficher le menu selon le rôle
-        if (role == "Client") {
-            montrerMenuClient();
+        if (role == ROLE_CLIENT) {
+            montrerMenuClient(*user);
         }
-        else if (role == "Admin") {
+        else if (role == ROLE_ADMIN) {
             montrerMenuAdmin();
         }
-        else if (role == "SuperAdmin") {
+        else if (role == ROLE_SUPERADMIN) {
             montrerMenuSuperAdmin(gestionUsers);
         }
         